@@ -13,32 +13,50 @@
 
 namespace nns {
 
+// -----------------------------------------------------------------------------
+//  the ground truth of all l_p distances in p is found in one pass over the
+//  data, and the one of each p is written to its own file <prefix>.gt<p>.
 // -----------------------------------------------------------------------------
 template <class DType>
 int ground_truth(        // find ground truth
     int n,               // number of data  points
     int qn,              // number of query points
     int d,               // dimensionality
-    float p,             // l_p distance, p \in (0,2]
+    int np,              // number of l_p distances
+    const float *p,      // l_p distances, p \in (0,2] (np)
     const char *prefix,  // prefix of ground truth results
     const DType *data,   // data points
     const DType *query)  // query points
 {
     gettimeofday(&g_start_time, NULL);
-    Result *truth = new Result[qn * MAXK];
-    MinK_List *list = new MinK_List(MAXK);
-
-    for (int i = 0; i < qn; ++i) {
-        kNN_search(n, d, MAXK, p, data, &query[(uint64_t)i * d], list);
+    Result *truth = new Result[(uint64_t)qn * MAXK];
+    MinK_List **lists = new MinK_List *[(uint64_t)np * qn];
+    for (uint64_t i = 0; i < (uint64_t)np * qn; ++i) lists[i] = new MinK_List(MAXK);
+
+    // l2 norms of data for norm expansion (only if it is exact)
+    float *norms = NULL;
+    for (int l = 0; l < np; ++l) {
+        if (get_metric(p[l]) == METRIC_L2 && is_exact_norm<DType>(d) && norms == NULL) {
+            norms = new float[n];
+            calc_l2_norms<DType>(n, d, data, norms);
+        }
+    }
+    kNN_join<DType>(n, qn, d, MAXK, np, p, data, query, lists, (const float *)norms);
 
-        for (int j = 0; j < MAXK; ++j) {
-            truth[i * MAXK + j].id_ = list->ith_id(j);
-            truth[i * MAXK + j].key_ = list->ith_key(j);
+    for (int l = 0; l < np; ++l) {
+        for (int i = 0; i < qn; ++i) {
+            MinK_List *list = lists[(uint64_t)l * qn + i];
+            for (int j = 0; j < MAXK; ++j) {
+                truth[(uint64_t)i * MAXK + j].id_ = list->ith_id(j);
+                truth[(uint64_t)i * MAXK + j].key_ = list->ith_key(j);
+            }
+            delete list;
         }
+        write_ground_truth(qn, MAXK, p[l], prefix, (const Result *)truth);
     }
-    write_ground_truth(qn, MAXK, p, prefix, (const Result *)truth);
-    delete list;
+    delete[] lists;
     delete[] truth;
+    if (norms != NULL) delete[] norms;
 
     gettimeofday(&g_end_time, NULL);
     float truth_time =
@@ -70,21 +88,23 @@ int linear_scan(          // brute-force linear scan (data on disk)
     }
 
     //  k-NN search by Linear Scan (assume data on disk)
-    printf("k-NN Search by Linear Scan:\n");
+    printf("k-NN Search by Linear Scan (a batch of %d queries):\n", qn);
     printf("Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
     for (int top_k : TOPKs) {
         gettimeofday(&g_start_time, NULL);
-        MinK_List *list = new MinK_List(top_k);
+        MinK_List **lists = new MinK_List *[qn];
+        for (int i = 0; i < qn; ++i) lists[i] = new MinK_List(top_k);
         g_ratio = 0.0f;
         g_recall = 0.0f;
-        g_page_io = 0;
 
+        // all queries in one batch, so the i/o is shared by queries
+        g_page_io = linear<DType>(n, qn, d, B, p, top_k, query, dfolder, lists);
         for (int i = 0; i < qn; ++i) {
-            g_page_io += linear<DType>(n, d, B, p, top_k, &query[(uint64_t)i * d], dfolder, list);
-            g_ratio += calc_ratio(top_k, &truth[(uint64_t)i * MAXK], list);
-            g_recall += calc_recall(top_k, &truth[(uint64_t)i * MAXK], list);
+            g_ratio += calc_ratio(top_k, &truth[(uint64_t)i * MAXK], lists[i]);
+            g_recall += calc_recall(top_k, &truth[(uint64_t)i * MAXK], lists[i]);
+            delete lists[i];
         }
-        delete list;
+        delete[] lists;
         gettimeofday(&g_end_time, NULL);
         g_runtime = g_end_time.tv_sec - g_start_time.tv_sec + (g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
 
@@ -143,6 +163,10 @@ int indexing_of_qalsh_plus(  // indexing of qalsh+
     fprintf(fp, "Indexing Time = %f Seconds\n", g_indexing_time);
     fprintf(fp, "Estimated Mem = %f MB\n\n", g_estimated_mem);
 
+    // write build report
+    sprintf(fname, "%sqalsh_plus_build.json", ofolder);
+    write_build_report(fname, "QALSH+", g_indexing_time, g_estimated_mem);
+
     fclose(fp);
     delete lsh;
     return 0;
@@ -178,19 +202,21 @@ int knn_of_qalsh_plus(    // k-NN search of qalsh+
         g_end_time.tv_sec - g_start_time.tv_sec + (g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
     printf("Load QALSH+ Index = %f Seconds\n\n", g_indexing_time);
 
-    // c-k-ANNS by QALSH+
+    // c-k-ANNS by QALSH+ (with the io skipped by pca sketch or codes, if any)
+    bool bound = lsh->has_lower_bound();
     printf("k-NN Search by QALSH+: \n");
     for (int nb = 1; nb <= lsh->get_num_blocks(); ++nb) {
         printf("nb = %d\n", nb);
         fprintf(fp, "nb = %d\n", nb);
 
-        printf("Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
+        printf("Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall%s\n", bound ? "\t\tSkipped I/O" : "");
         for (int top_k : TOPKs) {
             gettimeofday(&g_start_time, NULL);
             MinK_List *list = new MinK_List(top_k);
             g_ratio = 0.0f;
             g_recall = 0.0f;
             g_page_io = 0;
+            uint64_t skip_io = lsh->get_skip_io();
 
             for (int i = 0; i < qn; ++i) {
                 g_page_io += lsh->knn(top_k, nb, &query[(uint64_t)i * d], dfolder, list);
@@ -206,9 +232,16 @@ int knn_of_qalsh_plus(    // k-NN search of qalsh+
             g_recall = g_recall / qn;
             g_runtime = (g_runtime * 1000.0f) / qn;
             g_page_io = (uint64_t)ceil((double)g_page_io / qn);
+            skip_io = (uint64_t)ceil((double)(lsh->get_skip_io() - skip_io) / qn);
 
-            printf("%d\t\t%.4f\t\t%llu\t\t%.2f\t\t%.2f\n", top_k, g_ratio, g_page_io, g_runtime, g_recall);
-            fprintf(fp, "%d\t%f\t%llu\t%f\t%f\n", top_k, g_ratio, g_page_io, g_runtime, g_recall);
+            printf("%d\t\t%.4f\t\t%llu\t\t%.2f\t\t%.2f", top_k, g_ratio, g_page_io, g_runtime, g_recall);
+            fprintf(fp, "%d\t%f\t%llu\t%f\t%f", top_k, g_ratio, g_page_io, g_runtime, g_recall);
+            if (bound) {
+                printf("\t\t%llu", skip_io);
+                fprintf(fp, "\t%llu", skip_io);
+            }
+            printf("\n");
+            fprintf(fp, "\n");
         }
         printf("\n");
         fprintf(fp, "\n");
@@ -227,7 +260,9 @@ int indexing_of_qalsh(    // indexing of qalsh
     float p,              // l_p distance, p \in (0,2]
     float zeta,           // symmetric factor of p-stable distr.
     float c,              // approximation ratio
-    const DType *data,    // data points
+    const DType *data,    // data points (NULL: build out of core)
+    const char *prefix,   // prefix of data set
+    const char *dfolder,  // data folder
     const char *ofolder)  // output folder
 {
     // open output file to record information of indexing
@@ -243,8 +278,14 @@ int indexing_of_qalsh(    // indexing of qalsh
     gettimeofday(&g_start_time, NULL);
     char path[200];
     sprintf(path, "%sqalsh/", ofolder);
-    QALSH<DType> *lsh = new QALSH<DType>(n, d, B, p, zeta, c, data, path);
+    QALSH<DType> *lsh = NULL;
+    if (data != NULL) {
+        lsh = new QALSH<DType>(n, d, B, p, zeta, c, data, path);
+    } else {
+        lsh = new QALSH<DType>(n, d, B, p, zeta, c, prefix, dfolder, path);
+    }
     lsh->display();
+    lsh->display_pipeline();
     gettimeofday(&g_end_time, NULL);
 
     // calculate indexing time and memory usage
@@ -258,6 +299,10 @@ int indexing_of_qalsh(    // indexing of qalsh
     fprintf(fp, "Indexing Time = %f Seconds\n", g_indexing_time);
     fprintf(fp, "Estimated Mem = %f MB\n\n", g_estimated_mem);
 
+    // write build report
+    sprintf(fname, "%sqalsh_build.json", ofolder);
+    write_build_report(fname, "QALSH", g_indexing_time, g_estimated_mem);
+
     // clean up
     fclose(fp);
     delete lsh;
@@ -294,15 +339,17 @@ int knn_of_qalsh(         // k-NN search of qalsh
         g_end_time.tv_sec - g_start_time.tv_sec + (g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
     printf("Load QALSH Index = %f Seconds\n\n", g_indexing_time);
 
-    // c-k-ANNS by QALSH
+    // c-k-ANNS by QALSH (with the io skipped by pca sketch or codes, if any)
+    bool bound = lsh->sk_dim_ > 0 || lsh->sq_ != NULL;
     printf("k-NN Search by QALSH: \n");
-    printf("Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
+    printf("Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall%s\n", bound ? "\t\tSkipped I/O" : "");
     for (int top_k : TOPKs) {
         gettimeofday(&g_start_time, NULL);
         MinK_List *list = new MinK_List(top_k);
         g_ratio = 0.0f;
         g_recall = 0.0f;
         g_page_io = 0;
+        uint64_t skip_io = lsh->skip_io_;
 
         for (int i = 0; i < qn; ++i) {
             g_page_io += lsh->knn(top_k, &query[(uint64_t)i * d], dfolder, list);
@@ -317,9 +364,16 @@ int knn_of_qalsh(         // k-NN search of qalsh
         g_recall = g_recall / qn;
         g_runtime = (g_runtime * 1000.0f) / qn;
         g_page_io = (uint64_t)ceil((double)g_page_io / qn);
+        skip_io = (uint64_t)ceil((double)(lsh->skip_io_ - skip_io) / qn);
 
-        printf("%d\t\t%.4f\t\t%llu\t\t%.2f\t\t%.2f\n", top_k, g_ratio, g_page_io, g_runtime, g_recall);
-        fprintf(fp, "%d\t%f\t%llu\t%f\t%f\n", top_k, g_ratio, g_page_io, g_runtime, g_recall);
+        printf("%d\t\t%.4f\t\t%llu\t\t%.2f\t\t%.2f", top_k, g_ratio, g_page_io, g_runtime, g_recall);
+        fprintf(fp, "%d\t%f\t%llu\t%f\t%f", top_k, g_ratio, g_page_io, g_runtime, g_recall);
+        if (bound) {
+            printf("\t\t%llu", skip_io);
+            fprintf(fp, "\t%llu", skip_io);
+        }
+        printf("\n");
+        fprintf(fp, "\n");
     }
     printf("\n");
     fprintf(fp, "\n");
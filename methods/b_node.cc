@@ -103,6 +103,7 @@ BIndexNode::~BIndexNode()  // destructor
         // if dirty, rewrite to disk
         int block_length = btree_->file_->get_blocklength();
         char *buf = new char[block_length];
+        memset(buf, 0, block_length * sizeof(char));
         write_to_buffer(buf);
         btree_->file_->write_block(buf, block_);
 
@@ -144,6 +145,7 @@ void BIndexNode::init(  // init a new node, which not exist
 
     // init block_, get new address
     char *blk = new char[b_length];
+    memset(blk, 0, b_length * sizeof(char));
     block_ = btree_->file_->append_block(blk);
     delete[] blk;
 }
@@ -303,6 +305,7 @@ BLeafNode::~BLeafNode()  // destructor
         int block_length = btree_->file_->get_blocklength();
 
         char *buf = new char[block_length];
+        memset(buf, 0, block_length * sizeof(char));
         write_to_buffer(buf);
         btree_->file_->write_block(buf, block_);
         delete[] buf;
@@ -352,6 +355,7 @@ void BLeafNode::init(  // init a new node, which not exist
     memset(id_, -1, capacity_ * sizeof(int));
 
     char *blk = new char[b_length];
+    memset(blk, 0, b_length * sizeof(char));
     block_ = btree_->file_->append_block(blk);
     delete[] blk;
 }
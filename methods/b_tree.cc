@@ -10,12 +10,15 @@ BTree::BTree()  // default constructor
     root_ = -1;
     file_ = NULL;
     root_ptr_ = NULL;
+    model_ = NULL;
+    first_leaf_ = -1;
 }
 
 // -----------------------------------------------------------------------------
 BTree::~BTree()  // destructor
 {
     char *header = new char[file_->get_blocklength()];
+    memset(header, 0, file_->get_blocklength() * sizeof(char));
     write_header(header);       // write root_ to header
     file_->set_header(header);  // write back to disk
     delete[] header;
@@ -24,6 +27,10 @@ BTree::~BTree()  // destructor
         delete root_ptr_;
         root_ptr_ = NULL;
     }
+    if (model_ != NULL) {
+        delete model_;
+        model_ = NULL;
+    }
     if (file_ != NULL) {
         delete file_;
         file_ = NULL;
@@ -76,10 +83,41 @@ void BTree::init_restore(  // load the tree from a tree file
     delete[] header;
 }
 
+// -----------------------------------------------------------------------------
+//  TableSource: source of sorted entries from a hash table in memory
+// -----------------------------------------------------------------------------
+struct TableSource {
+    const Result *table_;  // hash table
+    int pos_;              // position of next entry
+
+    inline bool next(Result &r) {
+        r = table_[pos_++];
+        return true;
+    }
+};
+
 // -----------------------------------------------------------------------------
 int BTree::bulkload(      // bulkload a tree from memory
     int n,                // number of entries
     const Result *table)  // hash table
+{
+    TableSource src = {table, 0};
+    return bulkload_from<TableSource>(n, src);
+}
+
+// -----------------------------------------------------------------------------
+int BTree::bulkload(  // bulkload a tree from sorted runs on disk
+    int n,            // number of entries
+    RunFile *runs)    // sorted runs (merge initialized)
+{
+    return bulkload_from<RunFile>(n, *runs);
+}
+
+// -----------------------------------------------------------------------------
+template <class Source>
+int BTree::bulkload_from(  // bulkload a tree from a source of sorted entries
+    int n,                 // number of entries
+    Source &src)           // source of entries
 {
     BIndexNode *index_child = NULL;
     BIndexNode *index_prev_nd = NULL;
@@ -99,9 +137,16 @@ int BTree::bulkload(      // bulkload a tree from memory
     int start_block = 0;     // position of first node
     int end_block = 0;       // position of last node
 
+    fence_key_.clear();
+    fence_block_.clear();
+    Result entry;
     for (int i = 0; i < n; ++i) {
-        id = table[i].id_;
-        key = table[i].key_;
+        if (!src.next(entry)) {
+            printf("Could not read entry %d of %s\n", i, file_->fname_);
+            return 1;
+        }
+        id = entry.id_;
+        key = entry.key_;
 
         if (!leaf_act_nd) {
             leaf_act_nd = new BLeafNode();
@@ -120,6 +165,10 @@ int BTree::bulkload(      // bulkload a tree from memory
                 leaf_prev_nd = NULL;
             }
             end_block = leaf_act_nd->get_block();
+
+            // the first entry of a leaf is its fence key
+            fence_key_.push_back(key);
+            fence_block_.push_back(end_block);
         }
         leaf_act_nd->add_new_child(id, key);  // add new entry
 
@@ -213,6 +262,76 @@ int BTree::bulkload(      // bulkload a tree from memory
     return 0;
 }
 
+// -----------------------------------------------------------------------------
+//  the level-1 index nodes store exactly one entry (first key, block) for each
+//  leaf node, so the fence directory can be loaded by scanning them from left
+//  to right without touching any leaf node.
+// -----------------------------------------------------------------------------
+void BTree::init_fence()  // load fence directory from level-1 index nodes
+{
+    fence_key_.clear();
+    fence_block_.clear();
+
+    // -------------------------------------------------------------------------
+    //  check the level of root first: if root is a leaf node, there is no
+    //  index node to skip and the directory is not needed
+    // -------------------------------------------------------------------------
+    char *blk = new char[file_->get_blocklength()];
+    file_->read_block(blk, root_);
+    char level = blk[0];
+    delete[] blk;
+    if (level == 0) return;
+
+    BIndexNode *index_node = new BIndexNode();
+    index_node->init_restore(this, root_);
+
+    // go down to the left-most index node in level 1
+    while (index_node->get_level() > 1) {
+        int block = index_node->get_son(0);
+        delete index_node;
+        index_node = new BIndexNode();
+        index_node->init_restore(this, block);
+    }
+
+    // scan all index nodes in level 1 and collect their entries
+    while (index_node != NULL) {
+        int num = index_node->get_num_entries();
+        for (int i = 0; i < num; ++i) {
+            fence_key_.push_back(index_node->get_key(i));
+            fence_block_.push_back(index_node->get_son(i));
+        }
+        BIndexNode *next_node = index_node->get_right_sibling();
+        delete index_node;
+        index_node = next_node;
+    }
+}
+
+// -----------------------------------------------------------------------------
+//  the learned index predicts the position of a leaf in the leaf level, which
+//  is mapped to its block directly, since bulkload() writes all leaves in
+//  consecutive blocks. the fence directory is released after fitting.
+// -----------------------------------------------------------------------------
+void BTree::init_model(  // fit learned index over the first keys of leaves
+    int eps)             // max error of prediction (number of leaves)
+{
+    if (!has_fence()) init_fence();
+    if (!has_fence()) return;  // root is a leaf node, no model
+
+    int num_leaves = (int)fence_key_.size();
+    for (int i = 1; i < num_leaves; ++i) {
+        if (fence_block_[i] != fence_block_[0] + i) {
+            printf("Leaves of %s are not consecutive\n", file_->fname_);
+            exit(1);
+        }
+    }
+    if (model_ != NULL) delete model_;
+    model_ = new PLA_Index(num_leaves, eps, fence_key_.data());
+    first_leaf_ = fence_block_[0];
+
+    std::vector<float>().swap(fence_key_);
+    std::vector<int>().swap(fence_block_);
+}
+
 // -----------------------------------------------------------------------------
 void BTree::load_root()  // load root of b-tree
 {
@@ -5,10 +5,13 @@
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 #include "b_node.h"
 #include "block_file.h"
 #include "def.h"
+#include "pla_index.h"
+#include "run_file.h"
 #include "util.h"
 
 namespace nns {
@@ -25,6 +28,11 @@ class BTree {
     BNode *root_ptr_;  // pointer of root
     BlockFile *file_;  // file in disk to store
 
+    std::vector<float> fence_key_;  // fence directory: first key of each leaf
+    std::vector<int> fence_block_;  // fence directory: block of each leaf
+    PLA_Index *model_;              // learned index: first key -> leaf
+    int first_leaf_;                // learned index: block of first leaf
+
     // -------------------------------------------------------------------------
     BTree();   // default constructor
     ~BTree();  // destructor
@@ -43,6 +51,54 @@ class BTree {
         int n,                 // number of entries
         const Result *table);  // hash table
 
+    // -------------------------------------------------------------------------
+    int bulkload(        // bulkload b-tree from sorted runs on disk
+        int n,           // number of entries
+        RunFile *runs);  // sorted runs (merge initialized)
+
+    // -------------------------------------------------------------------------
+    void init_fence();  // load fence directory from level-1 index nodes
+
+    // -------------------------------------------------------------------------
+    inline bool has_fence() { return !fence_key_.empty(); }
+
+    // -------------------------------------------------------------------------
+    //  find the last leaf whose first key is less than or equal to input key.
+    //  return -1 if input key is smaller than the first keys of all leaves.
+    // -------------------------------------------------------------------------
+    inline int find_leaf_by_key(float key) {
+        return (int)(std::upper_bound(fence_key_.begin(), fence_key_.end(), key) - fence_key_.begin()) - 1;
+    }
+
+    // -------------------------------------------------------------------------
+    void init_model(  // fit learned index over the first keys of leaves
+        int eps);     // max error of prediction (number of leaves)
+
+    // -------------------------------------------------------------------------
+    inline bool has_model() { return model_ != NULL; }
+
+    // -------------------------------------------------------------------------
+    //  predict the block of the last leaf whose first key is less than or
+    //  equal to input key. return -1 if key is smaller than all first keys.
+    // -------------------------------------------------------------------------
+    inline int predict_leaf_by_key(float key) {
+        int pos = model_->predict(key);
+        return pos < 0 ? -1 : first_leaf_ + pos;
+    }
+
+    // -------------------------------------------------------------------------
+    inline int get_first_leaf() { return first_leaf_; }
+
+    // -------------------------------------------------------------------------
+    inline uint64_t get_model_memory() {  // memory usage of learned index
+        return model_ != NULL ? model_->get_memory_usage() : 0;
+    }
+
+    // -------------------------------------------------------------------------
+    inline uint64_t get_fence_memory() {  // memory usage of fence directory
+        return (sizeof(float) + sizeof(int)) * fence_key_.size();
+    }
+
    protected:
     // -------------------------------------------------------------------------
     inline int read_header(const char *buf) {  // read root_ from buffer
@@ -56,6 +112,12 @@ class BTree {
         return sizeof(int);
     }
 
+    // -------------------------------------------------------------------------
+    template <class Source>
+    int bulkload_from(  // bulkload b-tree from a source of sorted entries
+        int n,          // number of entries
+        Source &src);   // source of entries
+
     // -------------------------------------------------------------------------
     void load_root();  // load root of b-tree
 
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+//  BoundedQueue: a blocking FIFO queue with bounded capacity, used to connect
+//  the stages of a pipeline. push() waits while the queue is full, and pop()
+//  waits while it is empty and not closed. once closed, pop() returns false
+//  after all remaining items are taken.
+// -----------------------------------------------------------------------------
+template <class T>
+class BoundedQueue {
+   public:
+    BoundedQueue(      // constructor
+        int capacity)  // max number of items
+        : capacity_(capacity), closed_(false) {}
+
+    // -------------------------------------------------------------------------
+    void push(            // push an item (wait if full)
+        const T &item) {  // item
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return (int)items_.size() < capacity_; });
+        items_.push_back(item);
+        not_empty_.notify_one();
+    }
+
+    // -------------------------------------------------------------------------
+    bool pop(       // pop an item (wait if empty)
+        T &item) {  // item (return)
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return !items_.empty() || closed_; });
+        if (items_.empty()) return false;
+
+        item = items_.front();
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    void close() {  // no more items will be pushed
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+   protected:
+    int capacity_;                       // max number of items
+    bool closed_;                        // is the queue closed?
+    std::deque<T> items_;                // items
+    std::mutex mutex_;                   // mutex of items
+    std::condition_variable not_full_;   // signal: queue is not full
+    std::condition_variable not_empty_;  // signal: queue is not empty
+};
+
+}  // end namespace nns
@@ -44,6 +44,28 @@ const float ANGLE = PI / 8.0f;
 const int CANDIDATES = 100;
 const int BFHEAD_LENGTH = sizeof(int) * 2;
 const int BTREE_LEAF_SIZE = 128;
+const int PLA_ERROR = 1;  // max error (in leaves) of learned index
+
+const int PROJ_TILE = 16;    // number of points in a tile of projection
+const int PROJ_BLOCK = 256;  // number of dimensions in a block of projection
+const int PROJ_GROUP = 8;    // max number of hash tables projected in a pass
+
+const int RADIX_BITS = 11;    // number of bits of a digit of radix sort
+const int RADIX_MIN_N = 256;  // min size to sort results by radix sort
+
+const int RNG_BATCH = 256;  // number of r.v. generated in a batch
+
+const int DIST_CHECK = 64;   // number of dimensions between early-abandon checks
+const int DIST_BATCH = 256;  // number of points verified in a batch
+
+const int GT_QTILE = 16;      // number of queries in a tile of ground truth
+const int GT_DTILE = 262144;  // max bytes of data points in a tile of ground truth
+
+const int SCAN_TILE = 262144;  // max bytes of data pages in a tile of linear scan
+
+const int PCA_SAMPLE = 8192;  // max number of points sampled for pca
+const int PCA_TILE = 128;     // number of points in a tile of covariance
+const int PCA_ITER = 30;      // number of iterations of pca
 
 // const std::vector<int> TOPKs = {1, 2, 5, 10, 20, 50, 100};
 const std::vector<int> TOPKs = {100};
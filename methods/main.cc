@@ -25,6 +25,8 @@ void usage()  // usage of the package
         "    -d    (integer)   dimensionality\n"
         "    -B    (integer)   page size\n"
         "    -p    (real)      l_p distance <==> p-stable distr. (0, 2]\n"
+        "    -pl   (string)    list of l_p distances, e.g., 0.5,1.0,2.0\n"
+        "                      (optional, ground truth only, instead of -p)\n"
         "    -z    (real)      symmetric factor of p-stable distr. [-1, 1]\n"
         "    -c    (real)      approximation ratio (c > 1)\n"
         "    -lf   (integer)   leaf size of kd-tree\n"
@@ -34,24 +36,46 @@ void usage()  // usage of the package
         "    -pf   (string)    prefix folder\n"
         "    -df   (string)    data folder to store new format of data\n"
         "    -of   (string)    output folder\n"
+        "    -lc   (integer)   leaf locator of b+ trees (optional)\n"
+        "                      0 - descent from root (default)\n"
+        "                      1 - in-memory fence directory\n"
+        "                      2 - learned piecewise-linear index\n"
+        "    -nt   (integer)   number of threads (optional, default 1)\n"
+        "    -mc   (integer)   memory cap (MB) of indexing out of core\n"
+        "                      (optional, QALSH only, default 0: in memory)\n"
+        "    -pj   (integer)   projection of hash functions (optional, p = 2)\n"
+        "                      0 - dense gaussian (default)\n"
+        "                      1 - structured hadamard\n"
+        "                      2 - very sparse\n"
+        "    -do   (integer)   dimension order of new format data (optional)\n"
+        "                      0 - storage order (default)\n"
+        "                      1 - decreasing variance\n"
+        "    -sk   (integer)   number of pca coordinates of in-memory sketch\n"
+        "                      (optional, default 0: no sketch)\n"
+        "    -sq   (integer)   bits of in-memory scalar quantization codes\n"
+        "                      (optional, 4 or 8, default 0: no codes)\n"
+        "    -rr   (real)      number of candidates re-ranked on disk by\n"
+        "                      exact distances, as a multiple of k\n"
+        "                      (optional, used with codes, default 2.0)\n"
         "\n"
         "--------------------------------------------------------------------\n"
         " The options of algorithms (-alg) are:                              \n"
         "--------------------------------------------------------------------\n"
         "    0 - Ground-Truth\n"
-        "        Params: -alg 0 -n -qn -d -p -dt -pf\n"
+        "        Params: -alg 0 -n -qn -d -p|-pl -dt -pf [-df] [-nt]\n"
+        "        (with -df, in the dimension order of its new format data)\n"
         "\n"
         "    1 - Two Level Indexing of QALSH+\n"
-        "        Params: -alg 1 -n -d -B -lf -L -M -p -z -c -dt -pf -df -of\n"
+        "        Params: -alg 1 -n -d -B -lf -L -M -p -z -c -dt -pf -df -of [-nt] [-pj] [-do] [-sk] [-sq]\n"
         "\n"
         "    2 - Two Level c-k-ANNS of QALSH+\n"
-        "        Params: -alg 2 -qn -d -p -dt -pf -df -of\n"
+        "        Params: -alg 2 -qn -d -p -dt -pf -df -of [-lc] [-rr]\n"
         "\n"
         "    3 - Indexing of QALSH\n"
-        "        Params: -alg 3 -n -d -B -p -z -c -dt -pf -df -of\n"
+        "        Params: -alg 3 -n -d -B -p -z -c -dt -pf -df -of [-nt] [-mc] [-pj] [-do] [-sk] [-sq]\n"
         "\n"
         "    4 - c-k-ANN Search of QALSH\n"
-        "        Params: -alg 4 -qn -d -p -dt -pf -df -of\n"
+        "        Params: -alg 4 -qn -d -p -dt -pf -df -of [-lc] [-rr]\n"
         "\n"
         "    5 - Linear Scan Search\n"
         "        Params: -alg 5 -n -qn -d -B -p -dt -pf -df -of\n"
@@ -74,6 +98,8 @@ void interface(           // interface for calling function
     int L,                // number of projection (drusilla)
     int M,                // number of candidates (drusilla)
     float p,              // p-stable distr. (0,2]
+    int np,               // number of l_p distances of ground truth
+    const float *p_list,  // l_p distances of ground truth (np)
     float zeta,           // symmetric factor of p-distr. [-1,1]
     float c,              // approximation ratio
     const char *prefix,   // prefix of data, query, and truth
@@ -88,18 +114,48 @@ void interface(           // interface for calling function
     DType *query = NULL;
     Result *truth = NULL;
 
-    if (alg == 0 || alg == 1 || alg == 3) {
+    bool in_memory = !(alg == 3 && g_mem_cap > 0);  // out-of-core indexing
+    if (np > 1 && alg != 0) {
+        printf("List of l_p distances is only supported by ground truth, ignored.\n");
+    }
+    if (g_mem_cap > 0 && alg != 3) {
+        printf("Memory cap is only supported by indexing of QALSH, ignored.\n");
+    }
+    if (g_proj > 0 && fabs(p - 2.0f) >= FLOATZERO) {
+        printf("Structured or sparse projection is only supported for p = 2, ignored.\n");
+    }
+    if (g_dim_order > 0 && alg != 1 && alg != 3) {
+        printf("Dimension order is only supported by indexing, ignored.\n");
+    }
+    if (g_sketch > 0 && alg != 1 && alg != 3) {
+        printf("PCA sketch is only built by indexing, ignored.\n");
+    }
+    if (g_sq_bits > 0 && alg != 1 && alg != 3) {
+        printf("Scalar quantization codes are only built by indexing, ignored.\n");
+    }
+    if ((alg == 0 || alg == 1 || alg == 3) && in_memory) {
         data = new DType[(uint64_t)n * d];
         if (read_data<DType>(n, d, 0, p, prefix, data)) exit(1);
-        if (alg == 1 || alg == 3) {
-            assert(B > 0);
-            write_data_new_form<DType>(n, d, B, (const DType *)data, dfolder);
-        }
     }
     if (alg == 0 || alg == 2 || alg == 4 || alg == 5) {
         query = new DType[(uint64_t)qn * d];
         if (read_data<DType>(qn, d, 1, p, prefix, query)) exit(1);
     }
+    if (alg > 0 || dfolder[0] != '\0') {
+        // data and queries follow the dimension order of new format data, so
+        // the ground truth sums the distances in the same order as the search
+        int *order = get_dim_order<DType>(n, d, alg == 1 || alg == 3, prefix, dfolder, (const DType *)data);
+        if (order != NULL) {
+            if (alg == 0) printf("Ground truth in the dimension order of %sorder\n\n", dfolder);
+            if (data != NULL) reorder_dims<DType>(n, d, (const int *)order, data);
+            if (query != NULL) reorder_dims<DType>(qn, d, (const int *)order, query);
+            delete[] order;
+        }
+    }
+    if ((alg == 1 || alg == 3) && in_memory) {
+        assert(B > 0);
+        write_data_new_form<DType>(n, d, B, (const DType *)data, dfolder);
+    }
     if (alg == 2 || alg == 4 || alg == 5) {
         truth = new Result[(uint64_t)qn * MAXK];
         if (read_data<Result>(qn, MAXK, 2, p, prefix, truth)) exit(1);
@@ -113,7 +169,7 @@ void interface(           // interface for calling function
     // methods
     switch (alg) {
         case 0:
-            ground_truth<DType>(n, qn, d, p, prefix, (const DType *)data, (const DType *)query);
+            ground_truth<DType>(n, qn, d, np, p_list, prefix, (const DType *)data, (const DType *)query);
             break;
         case 1:
             indexing_of_qalsh_plus<DType>(n, d, B, leaf, L, M, p, zeta, c, (const DType *)data, ofolder);
@@ -122,7 +178,7 @@ void interface(           // interface for calling function
             knn_of_qalsh_plus<DType>(qn, d, (const DType *)query, (const Result *)truth, dfolder, ofolder);
             break;
         case 3:
-            indexing_of_qalsh<DType>(n, d, B, p, zeta, c, (const DType *)data, ofolder);
+            indexing_of_qalsh<DType>(n, d, B, p, zeta, c, (const DType *)data, prefix, dfolder, ofolder);
             break;
         case 4:
             knn_of_qalsh<DType>(qn, d, (const DType *)query, (const Result *)truth, dfolder, ofolder);
@@ -135,7 +191,7 @@ void interface(           // interface for calling function
             usage();
     }
     //  release space
-    if (alg == 0 || alg == 1 || alg == 3) delete[] data;
+    if (data != NULL) delete[] data;
     if (alg == 0 || alg == 2 || alg == 4 || alg == 5) delete[] query;
     if (alg == 2 || alg == 4 || alg == 5) delete[] truth;
 }
@@ -151,6 +207,8 @@ int main(int nargs, char **args) {
     int d = -1;          // dimensionality
     int B = -1;          // page size
     float p = -1.0f;     // p-stable distr. (0,2]
+    int np = 0;          // number of l_p distances of ground truth
+    float p_list[20];    // l_p distances of ground truth
     float zeta = -2.0f;  // symmetric factor of p-distr. [-1,1]
     float c = -1.0f;     // approximation ratio
     int leaf = -1;       // leaf size of kd-tree (QALSH+)
@@ -158,9 +216,10 @@ int main(int nargs, char **args) {
     int M = -1;          // #candidates  for drusilla-select (QALSH+)
     char dtype[20];      // data type
     char prefix[200];    // prefix of data, query, and truth set
-    char dfolder[200];   // data folder
+    char dfolder[200];   // data folder (optional for ground truth)
     char ofolder[200];   // output folder
 
+    dfolder[0] = '\0';
     while (cnt < nargs) {
         if (strcmp(args[cnt], "-alg") == 0) {
             alg = atoi(args[++cnt]);
@@ -198,6 +257,18 @@ int main(int nargs, char **args) {
             p = (float)atof(args[++cnt]);
             assert(p > 0 && p <= 2);
             printf("p       = %.1f\n", p);
+        } else if (strcmp(args[cnt], "-pl") == 0) {
+            char buf[200];
+            strncpy(buf, args[++cnt], sizeof(buf) - 1);
+            buf[sizeof(buf) - 1] = '\0';
+            printf("p list  =");
+            for (char *tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+                assert(np < 20);
+                p_list[np] = (float)atof(tok);
+                assert(p_list[np] > 0 && p_list[np] <= 2);
+                printf(" %.1f", p_list[np++]);
+            }
+            printf("\n");
         } else if (strcmp(args[cnt], "-z") == 0) {
             zeta = (float)atof(args[++cnt]);
             assert(zeta >= -1 && zeta <= 1);
@@ -230,6 +301,38 @@ int main(int nargs, char **args) {
             }
             printf("ofolder = %s\n", ofolder);
             create_dir(ofolder);
+        } else if (strcmp(args[cnt], "-lc") == 0) {
+            g_locator = atoi(args[++cnt]);
+            assert(g_locator >= 0 && g_locator <= 2);
+            printf("locator = %d\n", g_locator);
+        } else if (strcmp(args[cnt], "-nt") == 0) {
+            g_num_threads = atoi(args[++cnt]);
+            assert(g_num_threads > 0);
+            printf("threads = %d\n", g_num_threads);
+        } else if (strcmp(args[cnt], "-mc") == 0) {
+            g_mem_cap = atoi(args[++cnt]);
+            assert(g_mem_cap >= 0);
+            printf("mem cap = %d MB\n", g_mem_cap);
+        } else if (strcmp(args[cnt], "-pj") == 0) {
+            g_proj = atoi(args[++cnt]);
+            assert(g_proj >= 0 && g_proj <= 2);
+            printf("projection = %d\n", g_proj);
+        } else if (strcmp(args[cnt], "-do") == 0) {
+            g_dim_order = atoi(args[++cnt]);
+            assert(g_dim_order >= 0 && g_dim_order <= 1);
+            printf("dim order = %d\n", g_dim_order);
+        } else if (strcmp(args[cnt], "-sk") == 0) {
+            g_sketch = atoi(args[++cnt]);
+            assert(g_sketch >= 0);
+            printf("sketch  = %d\n", g_sketch);
+        } else if (strcmp(args[cnt], "-sq") == 0) {
+            g_sq_bits = atoi(args[++cnt]);
+            assert(g_sq_bits == 0 || g_sq_bits == 4 || g_sq_bits == 8);
+            printf("sq bits = %d\n", g_sq_bits);
+        } else if (strcmp(args[cnt], "-rr") == 0) {
+            g_rerank = (float)atof(args[++cnt]);
+            assert(g_rerank >= 1.0f);
+            printf("rerank  = %.1f\n", g_rerank);
         } else {
             printf("Parameters error!\n");
             usage();
@@ -239,14 +342,16 @@ int main(int nargs, char **args) {
     }
     printf("\n");
 
+    if (np == 0 && p > 0) p_list[np++] = p;  // ground truth of -p only
+
     if (strcmp(dtype, "uint8") == 0) {
-        interface<uint8_t>(alg, n, qn, d, B, leaf, L, M, p, zeta, c, prefix, dfolder, ofolder);
+        interface<uint8_t>(alg, n, qn, d, B, leaf, L, M, p, np, p_list, zeta, c, prefix, dfolder, ofolder);
     } else if (strcmp(dtype, "uint16") == 0) {
-        interface<uint16_t>(alg, n, qn, d, B, leaf, L, M, p, zeta, c, prefix, dfolder, ofolder);
+        interface<uint16_t>(alg, n, qn, d, B, leaf, L, M, p, np, p_list, zeta, c, prefix, dfolder, ofolder);
     } else if (strcmp(dtype, "int32") == 0) {
-        interface<int>(alg, n, qn, d, B, leaf, L, M, p, zeta, c, prefix, dfolder, ofolder);
+        interface<int>(alg, n, qn, d, B, leaf, L, M, p, np, p_list, zeta, c, prefix, dfolder, ofolder);
     } else if (strcmp(dtype, "float32") == 0) {
-        interface<float>(alg, n, qn, d, B, leaf, L, M, p, zeta, c, prefix, dfolder, ofolder);
+        interface<float>(alg, n, qn, d, B, leaf, L, M, p, np, p_list, zeta, c, prefix, dfolder, ofolder);
     } else {
         printf("Parameters error!\n");
         usage();
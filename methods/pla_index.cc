@@ -0,0 +1,75 @@
+#include "pla_index.h"
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+PLA_Index::PLA_Index(  // constructor
+    int n,             // number of keys
+    int eps,           // max error of prediction
+    const float *key)  // sorted keys (ascending)
+    : n_(n), eps_(eps) {
+    assert(n > 0 && eps >= 0);
+    float *seg_key = new float[n];
+    float *seg_slope = new float[n];
+    int *seg_pos = new int[n];
+
+    // -------------------------------------------------------------------------
+    //  shrinking cone: a segment starts from (key[s], s) and keeps the range of
+    //  feasible slopes [lo, hi] such that every point (key[j], j) added to it
+    //  is predicted within error eps. once the range is empty, the segment is
+    //  closed and a new segment starts from the current point.
+    // -------------------------------------------------------------------------
+    num_segs_ = 0;
+    int s = 0;
+    double lo = 0.0, hi = MAXREAL;
+    for (int j = 1; j <= n; ++j) {
+        bool close = (j == n);
+        if (!close) {
+            double dx = (double)key[j] - (double)key[s];
+            if (dx <= 0.0) {
+                close = (j - s > eps_);  // duplicate keys cannot be separated
+            } else {
+                double new_lo = std::max(lo, (j - s - eps_) / dx);
+                double new_hi = std::min(hi, (j - s + eps_) / dx);
+                if (new_lo > new_hi) {
+                    close = true;
+                } else {
+                    lo = new_lo;
+                    hi = new_hi;
+                }
+            }
+        }
+        if (close) {
+            seg_key[num_segs_] = key[s];
+            seg_slope[num_segs_] = (float)(hi >= MAXREAL ? lo : (lo + hi) / 2.0);
+            seg_pos[num_segs_] = s;
+            ++num_segs_;
+
+            s = j;
+            lo = 0.0;
+            hi = MAXREAL;
+        }
+    }
+
+    // shrink the arrays to the number of segments
+    seg_key_ = new float[num_segs_];
+    seg_slope_ = new float[num_segs_];
+    seg_pos_ = new int[num_segs_];
+    memcpy(seg_key_, seg_key, sizeof(float) * num_segs_);
+    memcpy(seg_slope_, seg_slope, sizeof(float) * num_segs_);
+    memcpy(seg_pos_, seg_pos, sizeof(int) * num_segs_);
+
+    delete[] seg_key;
+    delete[] seg_slope;
+    delete[] seg_pos;
+}
+
+// -----------------------------------------------------------------------------
+PLA_Index::~PLA_Index()  // destructor
+{
+    delete[] seg_key_;
+    delete[] seg_slope_;
+    delete[] seg_pos_;
+}
+
+}  // end namespace nns
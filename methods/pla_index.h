@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "def.h"
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+//  PLA_Index: a learned index over a sorted array of keys. It fits a piecewise
+//  linear approximation (PLA) of the map key -> position with a bounded error
+//  eps, i.e., for each input key k_j, |predict(k_j) - j| <= eps. The segments
+//  are fitted in one pass by the shrinking cone algorithm.
+//
+//  Given any query key q, predict(q) returns an estimation of the position of
+//  the last key which is less than or equal to q (within eps + 1).
+// -----------------------------------------------------------------------------
+class PLA_Index {
+   public:
+    PLA_Index(              // constructor
+        int n,              // number of keys
+        int eps,            // max error of prediction
+        const float *key);  // sorted keys (ascending)
+
+    // -------------------------------------------------------------------------
+    ~PLA_Index();  // destructor
+
+    // -------------------------------------------------------------------------
+    //  return -1 if key is smaller than all keys
+    // -------------------------------------------------------------------------
+    inline int predict(float key) {
+        if (key < seg_key_[0]) return -1;
+        int i = (int)(std::upper_bound(seg_key_, seg_key_ + num_segs_, key) - seg_key_) - 1;
+
+        float pos = seg_pos_[i] + seg_slope_[i] * (key - seg_key_[i]);
+        if (pos < 0.0f) return 0;
+        if (pos >= (float)(n_ - 1)) return n_ - 1;
+        return (int)pos;
+    }
+
+    // -------------------------------------------------------------------------
+    inline int get_num_segments() { return num_segs_; }
+
+    // -------------------------------------------------------------------------
+    inline uint64_t get_memory_usage() {
+        return sizeof(*this) + (sizeof(float) * 2 + sizeof(int)) * num_segs_;
+    }
+
+   protected:
+    int n_;             // number of keys
+    int eps_;           // max error of prediction
+    int num_segs_;      // number of segments
+    float *seg_key_;    // first key of each segment
+    float *seg_slope_;  // slope of each segment
+    int *seg_pos_;      // position of first key of each segment
+};
+
+}  // end namespace nns
@@ -46,13 +46,129 @@ int ResultCompDesc(  // compare function for qsort (descending)
     return ret;
 }
 
+// -----------------------------------------------------------------------------
+static inline uint32_t radix_key(  // map key to unsigned int in the same order
+    float key)                     // key
+{
+    uint32_t u;
+    memcpy(&u, &key, sizeof(uint32_t));
+    if (u == 0x80000000u) u = 0;  // -0.0 == +0.0
+
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+// -----------------------------------------------------------------------------
+static inline uint32_t radix_id(  // map id to unsigned int in the same order
+    int id)                       // id
+{
+    return (uint32_t)id ^ 0x80000000u;
+}
+
+// -----------------------------------------------------------------------------
+//  LSD radix sort on (key, id) with digits of RADIX_BITS bits. ids are sorted
+//  first (skipped if they are in ascending order already), and then keys.
+//  passes whose digits are the same for all results are skipped.
+// -----------------------------------------------------------------------------
+static void radix_sort(  // sort results by radix sort
+    int n,               // number of results
+    bool desc,           // sort keys in descending order?
+    Result *res)         // results (return)
+{
+    const int num_passes = (32 + RADIX_BITS - 1) / RADIX_BITS;
+    const int size = 1 << RADIX_BITS;
+    const uint32_t mask = size - 1;
+    const uint32_t flip = desc ? 0xFFFFFFFFu : 0;
+
+    bool id_sorted = true;
+    for (int i = 1; i < n; ++i) {
+        if (res[i].id_ < res[i - 1].id_) {
+            id_sorted = false;
+            break;
+        }
+    }
+
+    // calc the histograms of all passes by one scan
+    int *hist = new int[2 * num_passes * size];
+    int *key_hist = hist;
+    int *id_hist = hist + num_passes * size;
+    memset(hist, 0, sizeof(int) * 2 * num_passes * size);
+
+    for (int i = 0; i < n; ++i) {
+        uint32_t k = radix_key(res[i].key_) ^ flip;
+        for (int p = 0; p < num_passes; ++p) {
+            ++key_hist[p * size + ((k >> (p * RADIX_BITS)) & mask)];
+        }
+        if (!id_sorted) {
+            uint32_t d = radix_id(res[i].id_);
+            for (int p = 0; p < num_passes; ++p) {
+                ++id_hist[p * size + ((d >> (p * RADIX_BITS)) & mask)];
+            }
+        }
+    }
+
+    // scatter the results pass by pass
+    Result *buf = new Result[n];
+    Result *src = res;
+    Result *dst = buf;
+    for (int pass = 0; pass < 2 * num_passes; ++pass) {
+        bool by_id = pass < num_passes;
+        int p = pass % num_passes;
+        if (by_id && id_sorted) continue;
+
+        int *cnt = (by_id ? id_hist : key_hist) + p * size;
+        int shift = p * RADIX_BITS;
+        uint32_t first = by_id ? radix_id(src[0].id_) : radix_key(src[0].key_) ^ flip;
+        if (cnt[(first >> shift) & mask] == n) continue;
+
+        int sum = 0;
+        for (int i = 0; i < size; ++i) {
+            int tmp = cnt[i];
+            cnt[i] = sum;
+            sum += tmp;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint32_t k = by_id ? radix_id(src[i].id_) : radix_key(src[i].key_) ^ flip;
+            dst[cnt[(k >> shift) & mask]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+    if (src != res) memcpy(res, src, sizeof(Result) * n);
+
+    delete[] buf;
+    delete[] hist;
+}
+
+// -----------------------------------------------------------------------------
+void sort_results(  // sort results (ascending)
+    int n,          // number of results
+    Result *res)    // results (return)
+{
+    if (n < RADIX_MIN_N) {
+        qsort(res, n, sizeof(Result), ResultComp);
+    } else {
+        radix_sort(n, false, res);
+    }
+}
+
+// -----------------------------------------------------------------------------
+void sort_results_desc(  // sort results (descending)
+    int n,               // number of results
+    Result *res)         // results (return)
+{
+    if (n < RADIX_MIN_N) {
+        qsort(res, n, sizeof(Result), ResultCompDesc);
+    } else {
+        radix_sort(n, true, res);
+    }
+}
+
 // -----------------------------------------------------------------------------
 MinK_List::MinK_List(  // constructor (given max size)
     int max)           // max size
 {
-    num_ = 0;
     k_ = max;
-    list_ = new Result[max + 1];
+    list_ = new Item[max];
+    reset();
 }
 
 // -----------------------------------------------------------------------------
@@ -65,22 +181,43 @@ MinK_List::~MinK_List()  // destructor
 }
 
 // -----------------------------------------------------------------------------
-float MinK_List::insert(  // insert item (inline for speed)
-    float key,            // key of item
-    int id)               // id of item
+void MinK_List::push(  // push an item into the heap (pop the max if full)
+    float key,         // key of item
+    int id)            // id of item
 {
-    int i = 0;
-    for (i = num_; i > 0; --i) {
-        if (key < list_[i - 1].key_)
-            list_[i] = list_[i - 1];
-        else
-            break;
+    Item item = {key, id, seq_++};
+    sorted_ = false;
+
+    if (num_ < k_) {
+        // sift up from the end
+        int i = num_++;
+        while (i > 0) {
+            int parent = (i - 1) >> 1;
+            if (!less(list_[parent], item)) break;
+            list_[i] = list_[parent];
+            i = parent;
+        }
+        list_[i] = item;
+    } else {
+        // replace the max and sift down from the root
+        int i = 0;
+        while (true) {
+            int child = 2 * i + 1;
+            if (child >= num_) break;
+            if (child + 1 < num_ && less(list_[child], list_[child + 1])) ++child;
+            if (!less(item, list_[child])) break;
+            list_[i] = list_[child];
+            i = child;
+        }
+        list_[i] = item;
     }
-    list_[i].key_ = key;  // store new item here
-    list_[i].id_ = id;
-    if (num_ < k_) ++num_;  // increase the number of items
+}
 
-    return max_key();
+// -----------------------------------------------------------------------------
+void MinK_List::sort()  // sort the heap in descending order
+{
+    std::sort(list_, list_ + num_, [this](const Item &a, const Item &b) { return less(b, a); });
+    sorted_ = true;
 }
 
 }  // end namespace nns
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #include "def.h"
@@ -31,8 +34,31 @@ int ResultCompDesc(   // compare function for qsort (descending)
     const void *e1,   // 1st element
     const void *e2);  // 2nd element
 
+// -----------------------------------------------------------------------------
+//  sort results by LSD radix sort. the order is the same as qsort() with
+//  ResultComp (sort_results) and ResultCompDesc (sort_results_desc), i.e.,
+//  the keys are sorted in ascending (descending) order and ties are broken by
+//  ids in ascending order.
+// -----------------------------------------------------------------------------
+void sort_results(  // sort results (ascending)
+    int n,          // number of results
+    Result *res);   // results (return)
+
+// -----------------------------------------------------------------------------
+void sort_results_desc(  // sort results (descending)
+    int n,               // number of results
+    Result *res);        // results (return)
+
 // -----------------------------------------------------------------------------
 //  MinK_List maintains the smallest k values (float) and the k object ids (int)
+//
+//  the items are kept in a bounded max-heap, so an item larger than max_key()
+//  of a full list is rejected by one compare, and the others take O(log k).
+//  ties are broken by the order of insertion (the earlier one is smaller), so
+//  the results are the same as keeping the list sorted by a stable insertion.
+//  the list is sorted only when it is read by ith_key() or ith_id(). as a list
+//  sorted in descending order is also a max-heap, it is kept that way and
+//  read from the end.
 // -----------------------------------------------------------------------------
 class MinK_List {
    public:
@@ -40,19 +66,31 @@ class MinK_List {
     ~MinK_List();        // destructor
 
     // -------------------------------------------------------------------------
-    inline void reset() { num_ = 0; }
+    inline void reset() {
+        num_ = 0;
+        seq_ = 0;
+        sorted_ = true;
+    }
 
     // -------------------------------------------------------------------------
-    inline float min_key() { return (num_ > 0 ? list_[0].key_ : MAXREAL); }
+    inline float min_key() { return ith_key(0); }
 
     // -------------------------------------------------------------------------
-    inline float max_key() { return (num_ >= k_ ? list_[k_ - 1].key_ : MAXREAL); }
+    inline float max_key() { return (num_ >= k_ ? list_[0].key_ : MAXREAL); }
 
     // -------------------------------------------------------------------------
-    inline float ith_key(int i) { return (i < num_ ? list_[i].key_ : MAXREAL); }
+    inline float ith_key(int i) {
+        if (i >= num_) return MAXREAL;
+        if (!sorted_) sort();
+        return list_[num_ - 1 - i].key_;
+    }
 
     // -------------------------------------------------------------------------
-    inline int ith_id(int i) { return (i < num_ ? list_[i].id_ : MININT); }
+    inline int ith_id(int i) {
+        if (i >= num_) return MININT;
+        if (!sorted_) sort();
+        return list_[num_ - 1 - i].id_;
+    }
 
     // -------------------------------------------------------------------------
     inline int size() { return num_; }
@@ -66,14 +104,51 @@ class MinK_List {
     }
 
     // -------------------------------------------------------------------------
-    float insert(   // insert item
-        float key,  // key of item
-        int id);    // id of item
+    inline float insert(  // insert item (return max_key())
+        float key,        // key of item
+        int id)           // id of item
+    {
+        if (num_ < k_ || key < list_[0].key_) push(key, id);
+        return max_key();
+    }
+
+    // -------------------------------------------------------------------------
+    inline float insert_batch(  // insert items of consecutive ids (return max_key())
+        int n,                  // number of items
+        const float *keys,      // keys of items
+        int id)                 // id of the first item
+    {
+        for (int i = 0; i < n; ++i) {
+            if (num_ < k_ || keys[i] < list_[0].key_) push(keys[i], id + i);
+        }
+        return max_key();
+    }
 
    protected:
+    struct Item {       // an item of the heap
+        float key_;     // key of item
+        int id_;        // id of item
+        uint32_t seq_;  // order of insertion (to break ties)
+    };
+
     int k_;         // max number of keys
     int num_;       // number of key current active
-    Result *list_;  // the list itself
+    uint32_t seq_;  // number of items inserted since reset()
+    bool sorted_;   // is the heap sorted in descending order?
+    Item *list_;    // the list itself (a max-heap)
+
+    // -------------------------------------------------------------------------
+    inline bool less(const Item &a, const Item &b) {  // order of items
+        return a.key_ < b.key_ || (a.key_ == b.key_ && a.seq_ < b.seq_);
+    }
+
+    // -------------------------------------------------------------------------
+    void push(      // push an item into the heap (pop the max if full)
+        float key,  // key of item
+        int id);    // id of item
+
+    // -------------------------------------------------------------------------
+    void sort();  // sort the heap in descending order
 };
 
 }  // end namespace nns
@@ -1,14 +1,20 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "b_node.h"
 #include "b_tree.h"
+#include "bounded_queue.h"
 #include "def.h"
 #include "pri_queue.h"
 #include "random.h"
+#include "scalar_quantizer.h"
+#include "simd.h"
 #include "util.h"
 
 namespace nns {
@@ -46,11 +52,33 @@ class QALSH {
     float w_;           // bucket width
     int m_;             // number of hash tables
     int l_;             // collision threshold
-    float *a_;          // query-aware lsh hash functions
+    float *a_;          // query-aware lsh hash functions (dense)
+    int proj_;          // projection of hash functions (0-2)
+    int hd_size_;       // hadamard: size of transform (power of 2)
+    float *hd_sign_;    // hadamard: random signs of each block
+    int *hd_perm_;      // hadamard: random permutation of each block
+    float *hd_gauss_;   // hadamard: gaussian scaling of each block
+    int *sp_start_;     // sparse: start of non-zeros of each hash function
+    int *sp_idx_;       // sparse: dimension of each non-zero
+    float *sp_val_;     // sparse: value of each non-zero
     BTree **trees_;     // B+ Trees
     uint64_t dist_io_;  // io for computing distance
     uint64_t page_io_;  // io for scanning pages
 
+    int sk_dim_;           // sketch: number of pca coordinates (0: no sketch)
+    float *sk_basis_;      // sketch: pca basis (sk_dim_ * dim_)
+    float *sk_data_;       // sketch: pca coordinates of data (n_pts_ * sk_dim_)
+    ScalarQuantizer *sq_;  // codes: in-memory codes of data (NULL: no codes)
+    float sq_err_;         // codes: max l_p distance of a point to its decoding
+    uint64_t skip_io_;     // io avoided by lower bounds (all queries)
+
+    int num_proj_;       // pipeline: number of threads of projection
+    int num_sort_;       // pipeline: number of threads of sort
+    double wall_time_;   // pipeline: wall-clock time (seconds)
+    double proj_busy_;   // pipeline: busy time of projection (seconds)
+    double sort_busy_;   // pipeline: busy time of sort (seconds)
+    double write_busy_;  // pipeline: busy time of tree write (seconds)
+
     // -------------------------------------------------------------------------
     QALSH(                         // constructor (build lsh index)
         int n,                     // number of data points
@@ -63,6 +91,18 @@ class QALSH {
         const char *path,          // index path
         const int *index = NULL);  // data index
 
+    // -------------------------------------------------------------------------
+    QALSH(                    // constructor (build lsh index out of core)
+        int n,                // number of data points
+        int d,                // data dimension
+        int B,                // page size
+        float p,              // l_p distance, p \in (0,2]
+        float zeta,           // symmetric factor of p-stable distr.
+        float c,              // approximation ratio
+        const char *prefix,   // prefix of data set
+        const char *dfolder,  // data folder
+        const char *path);    // index path
+
     // -------------------------------------------------------------------------
     QALSH(                         // constructor (load lsh index)
         const char *path,          // index path
@@ -74,13 +114,28 @@ class QALSH {
     // -------------------------------------------------------------------------
     void display();  // display parameters
 
+    // -------------------------------------------------------------------------
+    void display_pipeline();  // display utilization of build pipeline
+
     // -------------------------------------------------------------------------
     uint64_t get_memory_usage() {  // get estimated memory usage
         uint64_t ret = 0ULL;
         ret += sizeof(*this);
-        ret += sizeof(float) * m_ * dim_;  // a_
-        for (int i = 0; i < m_; ++i) {     // trees_
-            ret += B_;                     // each tree only allocates B_ bytes
+        if (proj_ != 2) ret += sizeof(float) * m_ * dim_;  // a_
+        if (proj_ == 1) {  // hd_sign_, hd_perm_, hd_gauss_
+            ret += (sizeof(float) * 2 + sizeof(int)) * get_hd_blocks() * hd_size_;
+        }
+        if (proj_ == 2) {  // sp_start_, sp_idx_, sp_val_
+            ret += sizeof(int) * (m_ + 1) + (sizeof(int) + sizeof(float)) * sp_start_[m_];
+        }
+        if (sk_dim_ > 0) {  // sk_basis_, sk_data_
+            ret += sizeof(float) * ((uint64_t)sk_dim_ * dim_ + (uint64_t)n_pts_ * sk_dim_);
+        }
+        if (sq_ != NULL) ret += sq_->get_memory_usage();  // sq_
+        for (int i = 0; i < m_; ++i) {  // trees_
+            ret += B_;                  // each tree only allocates B_ bytes
+            if (g_locator == 1) ret += trees_[i]->get_fence_memory();
+            if (g_locator == 2) ret += trees_[i]->get_model_memory();
         }
         return ret;
     }
@@ -107,23 +162,158 @@ class QALSH {
 
     inline float calc_l2_prob(float x) { return new_gaussian_prob(x); }
 
+    // -------------------------------------------------------------------------
+    void init_params();  // init <w_> <m_> <l_> and hash functions
+
+    // -------------------------------------------------------------------------
+    void init_hadamard();  // init structured hash functions (p = 2)
+
+    // -------------------------------------------------------------------------
+    inline int get_hd_blocks() { return (m_ + hd_size_ - 1) / hd_size_; }
+
+    // -------------------------------------------------------------------------
+    void init_sparse();  // init very sparse hash functions (p = 2)
+
+    // -------------------------------------------------------------------------
+    void init_sparse_lists(  // init index lists of sparse hash functions
+        const float *a);     // dense hash functions (m_ * dim_)
+
+    // -------------------------------------------------------------------------
+    void hadamard_transform(  // calc hash values of a block of hash tables
+        int block,            // block id
+        float *x,             // padded input (size hd_size_, destroyed)
+        float *y);            // hash values (size hd_size_) (return)
+
     // -------------------------------------------------------------------------
     int write_params();  // write parameters to disk
 
+    // -------------------------------------------------------------------------
+    int init_sketch(           // init pca basis and sketch of data points
+        const DType *data,     // data points (NULL: out of core)
+        const char *prefix,    // prefix of data set
+        const char *dfolder);  // data folder
+
+    // -------------------------------------------------------------------------
+    void calc_sketches(     // calc sketch of data points
+        int n,              // number of data points
+        const DType *data,  // data points
+        float *sketch);     // sketch (n * sk_dim_) (return)
+
+    // -------------------------------------------------------------------------
+    int write_sketch();  // write pca basis and sketch to disk
+
+    // -------------------------------------------------------------------------
+    int read_sketch();  // read pca basis and sketch from disk (if any)
+
+    // -------------------------------------------------------------------------
+    int init_codes(            // init scalar quantization codes of data points
+        const DType *data,     // data points (NULL: out of core)
+        const char *prefix,    // prefix of data set
+        const char *dfolder);  // data folder
+
+    // -------------------------------------------------------------------------
+    int write_codes();  // write codes to disk
+
+    // -------------------------------------------------------------------------
+    int read_codes();  // read codes from disk (if any)
+
+    // -------------------------------------------------------------------------
+    template <class Metric>
+    inline void check_code(  // rank a candidate by its code
+        int id,              // candidate id
+        const float *query,  // query point (float)
+        float *x,            // buffer of decoded point
+        MinK_List *cand)     // candidates ranked by codes (return)
+    {
+        sq_->decode(id, x);
+        float dist = Metric::template dist<float>(dim_, p_, cand->max_key(), x, query);
+        cand->insert(dist, id);
+    }
+
+    // -------------------------------------------------------------------------
+    template <class Metric>
+    void rerank(              // re-rank candidates by exact distances
+        const DType *query,   // query point
+        const float *q_sk,    // sketch of query (allow NULL)
+        const char *dfolder,  // data folder
+        DType *data,          // buffer of data point
+        MinK_List *cand,      // candidates ranked by codes
+        MinK_List *list);     // k-NN results (return)
+
+    // -------------------------------------------------------------------------
+    inline bool is_pruned(  // is a candidate pruned by the lower bound of sketch?
+        int id,             // candidate id
+        const float *q_sk,  // sketch of query
+        float kdist)        // k-th nn distance so far
+    {
+        if (sk_dim_ == 0) return false;
+
+        // |V (o - q)|_2 <= |o - q|_2 <= |o - q|_p for orthonormal V, p <= 2,
+        // with a small margin for the rounding of float (as get_error() of sq)
+        float bound = SQR(kdist * (1.0f + 1e-4f));
+        if (simd_l2_sqr<float>(sk_dim_, bound, &sk_data_[(uint64_t)id * sk_dim_], q_sk) <= bound) return false;
+        ++skip_io_;
+        return true;
+    }
+
     // -------------------------------------------------------------------------
     int bulkload(            // build b+trees by bulkloading
         const DType *data);  // data points
 
+    // -------------------------------------------------------------------------
+    int bulkload_ext(          // build b+trees out of core
+        const char *prefix,    // prefix of data set
+        const char *dfolder);  // data folder
+
+    // -------------------------------------------------------------------------
+    template <class Func>
+    int for_each_group(  // run func on each group of hash tables by threads
+        int group,       // number of hash tables in a group
+        int size,        // size of a scratch hash table
+        Func func);      // func(start, num, tables)
+
+    // -------------------------------------------------------------------------
+    void calc_tables(       // calc hash values of a group of hash tables
+        int start,          // first hash table id
+        int num,            // number of hash tables
+        int n,              // number of data points
+        int offset,         // id of the first data point
+        const DType *data,  // data points
+        Result **tables);   // hash tables (num, each n) (return)
+
     // -------------------------------------------------------------------------
     inline float calc_hash_value(int tid, const DType *data) {
+        if (proj_ == 2) {
+            int start = sp_start_[tid];
+            return calc_sparse_product<DType>(sp_start_[tid + 1] - start, &sp_idx_[start], &sp_val_[start], data);
+        }
         return calc_inner_product<DType>(dim_, &a_[tid * dim_], data);
     }
 
+    // -------------------------------------------------------------------------
+    void calc_hash_values(  // calc hash values of all hash tables
+        const DType *data,  // data point
+        float *h_val);      // hash values (return)
+
     // -------------------------------------------------------------------------
     inline void get_tree_filename(int tid, char *fname) {  // get fname of b+tree
         sprintf(fname, "%s%d.qalsh", path_, tid);
     }
 
+    // -------------------------------------------------------------------------
+    inline void get_run_filename(int tid, char *fname) {  // get fname of runs
+        sprintf(fname, "%s%d.run", path_, tid);
+    }
+
+    // -------------------------------------------------------------------------
+    inline uint64_t get_trees_size() {  // get size of b+ trees (bytes)
+        uint64_t size = 0;
+        for (int i = 0; i < m_; ++i) {
+            if (trees_[i] != NULL) size += (uint64_t)(trees_[i]->file_->get_num_of_blocks() + 1) * B_;
+        }
+        return size;
+    }
+
     // -------------------------------------------------------------------------
     int read_params();  // read parameters from disk
 
@@ -134,6 +324,27 @@ class QALSH {
         Page **lptrs,         // left  buffer (return)
         Page **rptrs);        // right buffer (return)
 
+    // -------------------------------------------------------------------------
+    BLeafNode *load_leaf(  // load a leaf node from disk
+        BTree *tree,       // b+ tree
+        int block);        // block of leaf node
+
+    // -------------------------------------------------------------------------
+    BLeafNode *locate_leaf_by_model(  // locate leaf by learned index
+        BTree *tree,                  // b+ tree
+        float q_v,                    // hash value of query
+        bool &lescape,                // no left buffer (return)
+        BLeafNode *&right);           // right sibling (return)
+
+    // -------------------------------------------------------------------------
+    void init_leaf_buffer(  // init buffers from a leaf node
+        BLeafNode *leaf,    // leaf node (loaded)
+        BLeafNode *right,   // right sibling of leaf (loaded or NULL)
+        bool lescape,       // query is smaller than all keys
+        float q_v,          // hash value of query
+        Page *lptr,         // left  buffer (return)
+        Page *rptr);        // right buffer (return)
+
     // -------------------------------------------------------------------------
     float find_radius(        // find proper radius
         const float *q_val,   // hash value of query
@@ -155,6 +366,22 @@ class QALSH {
         const Page *lptr,      // left  buffer
         Page *rptr);           // right buffer (return)
 
+    // -------------------------------------------------------------------------
+    template <class Metric>
+    uint64_t knn_metric(      // k-NN search (for one metric)
+        int top_k,            // top-k value
+        const DType *query,   // query point
+        const char *dfolder,  // data folder
+        MinK_List *list);     // k-NN results (return)
+
+    // -------------------------------------------------------------------------
+    template <class Metric>
+    uint64_t knn2_metric(     // k-NN search (for one metric)
+        int top_k,            // top-k value
+        const DType *query,   // query point
+        const char *dfolder,  // data folder
+        MinK_List *list);     // k-NN results (return)
+
     // -------------------------------------------------------------------------
     float calc_dist(       // calc projected distance
         float q_val,       // hash value of query
@@ -181,9 +408,83 @@ QALSH<DType>::QALSH(    // constructor (build lsh index)
     : n_pts_(n), dim_(d), B_(B), p_(p), zeta_(zeta), c_(c), index_(index) {
     dist_io_ = 0;
     page_io_ = 0;
+    num_proj_ = num_sort_ = 0;
+    wall_time_ = proj_busy_ = sort_busy_ = write_busy_ = 0.0;
+    sk_dim_ = 0;
+    sk_basis_ = sk_data_ = NULL;
+    sq_ = NULL;
+    sq_err_ = MAXREAL;
+    skip_io_ = 0;
+    strcpy(path_, path);
+    create_dir(path_);
+
+    // init parameters and write them to disk
+    double start_time = get_time();
+    char fname[200];
+    sprintf(fname, "%spara", path_);
+
+    init_params();
+    if (write_params()) exit(1);
+    add_build_phase("param_tuning", get_time() - start_time, get_file_size(fname));
+
+    //  pca sketch and codes of data points (optional)
+    if (g_sketch > 0 && init_sketch(data, NULL, NULL)) exit(1);
+    if (g_sq_bits > 0 && init_codes(data, NULL, NULL)) exit(1);
+
+    //  bulkloading
+    if (bulkload(data)) exit(1);
+    if (sk_dim_ > 0 && write_sketch()) exit(1);
+    if (sq_ != NULL && write_codes()) exit(1);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+QALSH<DType>::QALSH(      // constructor (build lsh index out of core)
+    int n,                // number of data points
+    int d,                // dimension of space
+    int B,                // page size
+    float p,              // l_p distance, p \in (0,2]
+    float zeta,           // symmetric factor of p-stable distr.
+    float c,              // approximation ratio
+    const char *prefix,   // prefix of data set
+    const char *dfolder,  // data folder
+    const char *path)     // index path
+    : n_pts_(n), dim_(d), B_(B), p_(p), zeta_(zeta), c_(c), index_(NULL) {
+    dist_io_ = 0;
+    page_io_ = 0;
+    num_proj_ = num_sort_ = 0;
+    wall_time_ = proj_busy_ = sort_busy_ = write_busy_ = 0.0;
+    sk_dim_ = 0;
+    sk_basis_ = sk_data_ = NULL;
+    sq_ = NULL;
+    sq_err_ = MAXREAL;
+    skip_io_ = 0;
     strcpy(path_, path);
     create_dir(path_);
 
+    // init parameters and write them to disk
+    double start_time = get_time();
+    char fname[200];
+    sprintf(fname, "%spara", path_);
+
+    init_params();
+    if (write_params()) exit(1);
+    add_build_phase("param_tuning", get_time() - start_time, get_file_size(fname));
+
+    //  pca sketch and codes of data points (optional, computed chunk by chunk)
+    if (g_sketch > 0 && init_sketch(NULL, prefix, dfolder)) exit(1);
+    if (g_sq_bits > 0 && init_codes(NULL, prefix, dfolder)) exit(1);
+
+    //  bulkloading from sorted runs on disk
+    if (bulkload_ext(prefix, dfolder)) exit(1);
+    if (sk_dim_ > 0 && write_sketch()) exit(1);
+    if (sq_ != NULL && write_codes()) exit(1);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::init_params()  // init <w_> <m_> <l_> and hash functions
+{
     // -------------------------------------------------------------------------
     //  init <w_> <m_> and <l_> (auto tuning-w)
     //
@@ -222,7 +523,8 @@ QALSH<DType>::QALSH(    // constructor (build lsh index)
         else
             w_ = (w2 - w1) * p_ + (2.0f * w1 - w2);
 
-        new_stable_prob(p_, zeta_, c_, 1.0f, w_, 1000000, p1, p2);
+        p1 = new_stable_prob(p_, zeta_, w_ / 2.0f);
+        p2 = new_stable_prob(p_, zeta_, w_ / (2.0f * c_));
     }
 
     float para1 = sqrt(log(2.0f / beta));
@@ -234,24 +536,197 @@ QALSH<DType>::QALSH(    // constructor (build lsh index)
     m_ = (int)ceil((para1 + para2) * (para1 + para2) / para3);
     l_ = (int)ceil(alpha * m_);
 
-    // generate hash functions
-    a_ = new float[m_ * dim_];
-    for (int i = 0; i < m_ * dim_; ++i) {
+    // generate hash functions (one random stream for each hash table)
+    proj_ = (fabs(p_ - 2.0f) < FLOATZERO) ? g_proj : 0;
+    hd_size_ = 0;
+    hd_sign_ = hd_gauss_ = NULL;
+    hd_perm_ = NULL;
+    sp_start_ = sp_idx_ = NULL;
+    sp_val_ = NULL;
+    if (proj_ == 2) {
+        init_sparse();
+        return;
+    }
+    a_ = simd_alloc((uint64_t)m_ * dim_);
+    if (proj_ == 1) {
+        init_hadamard();
+        return;
+    }
+    for (int i = 0; i < m_; ++i) {
+        Xoshiro rng(rand_seed());
+        float *a = &a_[(uint64_t)i * dim_];
+
         if (fabs(p_ - 0.5f) < FLOATZERO)
-            a_[i] = levy(1.0f, 0.0f);
+            levy(rng, dim_, 1.0f, 0.0f, a);
         else if (fabs(p_ - 1.0f) < FLOATZERO)
-            a_[i] = cauchy(1.0f, 0.0f);
+            cauchy(rng, dim_, 1.0f, 0.0f, a);
         else if (fabs(p_ - 2.0f) < FLOATZERO)
-            a_[i] = gaussian(0.0f, 1.0f);
+            gaussian(rng, dim_, 0.0f, 1.0f, a);
         else
-            a_[i] = p_stable(p_, zeta_, 1.0f, 0.0f);
+            p_stable(rng, dim_, p_, zeta_, 1.0f, 0.0f, a);
     }
+}
 
-    // write parameters to disk
-    if (write_params()) exit(1);
+// -----------------------------------------------------------------------------
+//  very sparse hash functions for p = 2 (Li, Hastie and Church, KDD 2006):
+//  each entry is +sqrt(s) or -sqrt(s) with probability 1 / (2s) each, and 0
+//  otherwise, where s = sqrt(d). the entries have zero mean and unit variance,
+//  so the projected distances are asymptotically N(0, ||o - q||^2), while
+//  each hash function has only about sqrt(d) non-zeros. the hash functions
+//  are kept as index lists in memory, but written to disk as dense a_.
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::init_sparse()  // init very sparse hash functions (p = 2)
+{
+    float s = sqrt((float)dim_);
+    float v = sqrt(s);
+    float *a = new float[m_ * dim_];
 
-    //  bulkloading
-    if (bulkload(data)) exit(1);
+    for (int i = 0; i < m_; ++i) {
+        Xoshiro rng(rand_seed());
+        float *row = &a[(uint64_t)i * dim_];
+        int nnz = 0;
+        while (nnz == 0) {  // re-draw the (rare) empty hash function
+            rng.uniform(dim_, row);
+            for (int j = 0; j < dim_; ++j) {
+                float u = row[j] * s;
+                row[j] = u < 0.5f ? v : (u < 1.0f ? -v : 0.0f);
+                if (row[j] != 0.0f) ++nnz;
+            }
+        }
+    }
+    init_sparse_lists(a);
+    delete[] a;
+    a_ = NULL;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::init_sparse_lists(  // init index lists of sparse hash functions
+    const float *a)                    // dense hash functions (m_ * dim_)
+{
+    int nnz = 0;
+    for (int i = 0; i < m_ * dim_; ++i) {
+        if (a[i] != 0.0f) ++nnz;
+    }
+    sp_start_ = new int[m_ + 1];
+    sp_idx_ = new int[nnz];
+    sp_val_ = new float[nnz];
+
+    nnz = 0;
+    for (int i = 0; i < m_; ++i) {
+        sp_start_[i] = nnz;
+        const float *row = &a[(uint64_t)i * dim_];
+        for (int j = 0; j < dim_; ++j) {
+            if (row[j] == 0.0f) continue;
+            sp_idx_[nnz] = j;
+            sp_val_[nnz] = row[j];
+            ++nnz;
+        }
+    }
+    sp_start_[m_] = nnz;
+}
+
+// -----------------------------------------------------------------------------
+//  structured hash functions for p = 2: each block of hd_size_ hash tables is
+//  the transform H G P H S / sqrt(hd_size_), where H is the walsh-hadamard
+//  matrix, S a diagonal of random signs, P a random permutation and G a
+//  diagonal of N(0, 1) r.v. (the fastfood transform without its row scaling).
+//
+//  given S and P, each row of a block is a linear map of G with covariance I,
+//  so every hash function is exactly N(0, I) as in the dense case (the rows of
+//  a block are only weakly correlated). the hash values of a query are then
+//  computed by two fwht per block, i.e., O(d log d) instead of O(m d); a_ is
+//  still materialized for bulkloading.
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::init_hadamard()  // init structured hash functions (p = 2)
+{
+    hd_size_ = 1;
+    while (hd_size_ < dim_) hd_size_ <<= 1;
+
+    int num_blocks = get_hd_blocks();
+    uint64_t size = (uint64_t)num_blocks * hd_size_;
+    hd_sign_ = new float[size];
+    hd_perm_ = new int[size];
+    hd_gauss_ = new float[size];
+
+    for (int i = 0; i < num_blocks; ++i) {
+        Xoshiro rng(rand_seed());
+        float *sign = &hd_sign_[(uint64_t)i * hd_size_];
+        int *perm = &hd_perm_[(uint64_t)i * hd_size_];
+        float *gauss = &hd_gauss_[(uint64_t)i * hd_size_];
+
+        rng.uniform(hd_size_, sign);
+        for (int j = 0; j < hd_size_; ++j) {
+            sign[j] = sign[j] < 0.5f ? -1.0f : 1.0f;
+            perm[j] = j;
+        }
+        for (int j = hd_size_ - 1; j > 0; --j) {
+            std::swap(perm[j], perm[rng.next() % (j + 1)]);
+        }
+        gaussian(rng, hd_size_, 0.0f, 1.0f, gauss);
+    }
+
+    // materialize a_: column k of a block is the transform of unit vector e_k
+    float *x = new float[hd_size_ * 2];
+    float *y = x + hd_size_;
+    for (int i = 0; i < num_blocks; ++i) {
+        int num = std::min(hd_size_, m_ - i * hd_size_);
+        for (int k = 0; k < dim_; ++k) {
+            memset(x, 0, sizeof(float) * hd_size_);
+            x[k] = 1.0f;
+            hadamard_transform(i, x, y);
+            for (int j = 0; j < num; ++j) {
+                a_[(uint64_t)(i * hd_size_ + j) * dim_ + k] = y[j];
+            }
+        }
+    }
+    delete[] x;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::hadamard_transform(  // calc hash values of a block of hash tables
+    int block,                          // block id
+    float *x,                           // padded input (size hd_size_, destroyed)
+    float *y)                           // hash values (size hd_size_) (return)
+{
+    const float *sign = &hd_sign_[(uint64_t)block * hd_size_];
+    const int *perm = &hd_perm_[(uint64_t)block * hd_size_];
+    const float *gauss = &hd_gauss_[(uint64_t)block * hd_size_];
+    float scale = 1.0f / sqrt((float)hd_size_);
+
+    for (int j = 0; j < hd_size_; ++j) x[j] *= sign[j];
+    fwht(hd_size_, x);
+    for (int j = 0; j < hd_size_; ++j) y[j] = gauss[j] * scale * x[perm[j]];
+    fwht(hd_size_, y);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::calc_hash_values(  // calc hash values of all hash tables
+    const DType *data,                // data point
+    float *h_val)                     // hash values (return)
+{
+    if (proj_ == 0) {
+        simd_gemv<DType>(m_, dim_, a_, data, h_val);
+        return;
+    } else if (proj_ == 2) {
+        for (int i = 0; i < m_; ++i) h_val[i] = calc_hash_value(i, data);
+        return;
+    }
+    float *x = new float[hd_size_ * 2];
+    float *y = x + hd_size_;
+    for (int i = 0; i < get_hd_blocks(); ++i) {
+        for (int j = 0; j < dim_; ++j) x[j] = (float)data[j];
+        for (int j = dim_; j < hd_size_; ++j) x[j] = 0.0f;
+        hadamard_transform(i, x, y);
+
+        int num = std::min(hd_size_, m_ - i * hd_size_);
+        memcpy(&h_val[i * hd_size_], y, sizeof(float) * num);
+    }
+    delete[] x;
 }
 
 // -----------------------------------------------------------------------------
@@ -278,48 +753,629 @@ int QALSH<DType>::write_params()  // write parameters to disk
     fwrite(&c_, sizeof(float), 1, fp);
     fwrite(&w_, sizeof(float), 1, fp);
 
-    fwrite(a_, sizeof(float), m_ * dim_, fp);
+    if (proj_ == 2) {
+        float *row = new float[dim_];
+        for (int i = 0; i < m_; ++i) {
+            memset(row, 0, sizeof(float) * dim_);
+            for (int j = sp_start_[i]; j < sp_start_[i + 1]; ++j) row[sp_idx_[j]] = sp_val_[j];
+            fwrite(row, sizeof(float), dim_, fp);
+        }
+        delete[] row;
+    } else {
+        fwrite(a_, sizeof(float), m_ * dim_, fp);
+    }
+
+    fwrite(&proj_, sizeof(int), 1, fp);
+    if (proj_ == 1) {
+        uint64_t size = (uint64_t)get_hd_blocks() * hd_size_;
+        fwrite(&hd_size_, sizeof(int), 1, fp);
+        fwrite(hd_sign_, sizeof(float), size, fp);
+        fwrite(hd_perm_, sizeof(int), size, fp);
+        fwrite(hd_gauss_, sizeof(float), size, fp);
+    }
     fclose(fp);
     return 0;
 }
 
+// -----------------------------------------------------------------------------
+//  pca sketch: the first <sk_dim_> pca coordinates of each data point are kept
+//  in memory. V has orthonormal rows, so |V o - V q|_2 is a lower bound of the
+//  l_p distance of o and q for any p \in (0,2]. a candidate whose bound is
+//  larger than the k-th nn distance so far cannot enter the k-NN results, so
+//  reading its data page is skipped (see is_pruned()).
+// -----------------------------------------------------------------------------
+template <class DType>
+int QALSH<DType>::init_sketch(  // init pca basis and sketch of data points
+    const DType *data,          // data points (NULL: out of core)
+    const char *prefix,         // prefix of data set
+    const char *dfolder)        // data folder
+{
+    double start_time = get_time();
+    sk_dim_ = std::min(g_sketch, dim_);
+    sk_basis_ = simd_alloc((uint64_t)sk_dim_ * dim_);
+    sk_data_ = new float[(uint64_t)n_pts_ * sk_dim_];
+    if (calc_pca_basis<DType>(n_pts_, dim_, sk_dim_, prefix, dfolder, data, sk_basis_)) return 1;
+
+    // the sketch of out-of-core data is computed by bulkload_ext()
+    if (data != NULL) calc_sketches(n_pts_, data, sk_data_);
+    add_build_phase("sketch", get_time() - start_time, 0);
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::calc_sketches(  // calc sketch of data points
+    int n,                         // number of data points
+    const DType *data,             // data points
+    float *sketch)                 // sketch (n * sk_dim_) (return)
+{
+    for (int i = 0; i < n; ++i) {
+        simd_gemv<DType>(sk_dim_, dim_, sk_basis_, &data[(uint64_t)i * dim_], &sketch[(uint64_t)i * sk_dim_]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+int QALSH<DType>::write_sketch()  // write pca basis and sketch to disk
+{
+    char fname[200];
+    sprintf(fname, "%ssketch", path_);
+    FILE *fp = fopen(fname, "wb");
+    if (!fp) {
+        printf("Could not create %s\n", fname);
+        return 1;
+    }
+    fwrite(&sk_dim_, sizeof(int), 1, fp);
+    fwrite(sk_basis_, sizeof(float), (uint64_t)sk_dim_ * dim_, fp);
+    fwrite(sk_data_, sizeof(float), (uint64_t)n_pts_ * sk_dim_, fp);
+    fclose(fp);
+
+    add_build_phase("sketch", 0.0, get_file_size(fname));
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+int QALSH<DType>::read_sketch()  // read pca basis and sketch from disk (if any)
+{
+    char fname[200];
+    sprintf(fname, "%ssketch", path_);
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) return 0;  // no sketch
+
+    int r = 0;
+    fread(&r, sizeof(int), 1, fp);
+    if (r <= 0 || r > dim_) {
+        printf("Could not read the sketch from %s\n", fname);
+        fclose(fp);
+        return 1;
+    }
+    sk_dim_ = r;
+    sk_basis_ = simd_alloc((uint64_t)sk_dim_ * dim_);
+    sk_data_ = new float[(uint64_t)n_pts_ * sk_dim_];
+    uint64_t size = (uint64_t)sk_dim_ * dim_;
+    uint64_t total = (uint64_t)n_pts_ * sk_dim_;
+    if (fread(sk_basis_, sizeof(float), size, fp) != size || fread(sk_data_, sizeof(float), total, fp) != total) {
+        printf("Could not read the sketch from %s\n", fname);
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+//  scalar quantization codes: the candidates are ranked by the distances to
+//  the decoded points in memory, and only the best ones are read from disk
+//  by rerank(). the ranges of dimensions are taken over all data points, so
+//  the out-of-core build reads the data set once more for the ranges.
+// -----------------------------------------------------------------------------
+template <class DType>
+int QALSH<DType>::init_codes(  // init scalar quantization codes of data points
+    const DType *data,         // data points (NULL: out of core)
+    const char *prefix,        // prefix of data set
+    const char *dfolder)       // data folder
+{
+    double start_time = get_time();
+    sq_ = new ScalarQuantizer(n_pts_, dim_, g_sq_bits);
+    if (data != NULL) {
+        sq_->update_range<DType>(n_pts_, data);
+        sq_->init_scale();
+        sq_->encode<DType>(n_pts_, 0, data);
+        add_build_phase("codes", get_time() - start_time, 0);
+        return 0;
+    }
+
+    // the ranges of out-of-core data (the codes are computed by bulkload_ext())
+    char fname[200];
+    sprintf(fname, "%s.ds", prefix);
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        printf("Could not open %s\n", fname);
+        return 1;
+    }
+    uint64_t mem = (uint64_t)g_mem_cap * 1048576;
+    int chunk = (int)std::min<uint64_t>(n_pts_, std::max<uint64_t>(1, mem / (dim_ * sizeof(DType))));
+    DType *buf = new DType[(uint64_t)chunk * dim_];
+    int *order = read_dim_order(dim_, dfolder);
+
+    int ret = 0;
+    for (int start = 0; start < n_pts_; start += chunk) {
+        int n = std::min(chunk, n_pts_ - start);
+        if (fread(buf, sizeof(DType), (uint64_t)n * dim_, fp) != (uint64_t)n * dim_) {
+            printf("Could not read %d data points from %s.ds\n", n_pts_, prefix);
+            ret = 1;
+            break;
+        }
+        if (order != NULL) reorder_dims<DType>(n, dim_, (const int *)order, buf);
+        sq_->update_range<DType>(n, buf);
+    }
+    sq_->init_scale();
+
+    delete[] buf;
+    if (order != NULL) delete[] order;
+    fclose(fp);
+    add_build_phase("codes", get_time() - start_time, 0);
+
+    return ret;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+int QALSH<DType>::write_codes()  // write codes to disk
+{
+    char fname[200];
+    sprintf(fname, "%scodes", path_);
+    if (sq_->write(fname)) return 1;
+
+    add_build_phase("codes", 0.0, get_file_size(fname));
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+int QALSH<DType>::read_codes()  // read codes from disk (if any)
+{
+    char fname[200];
+    sprintf(fname, "%scodes", path_);
+    if (access(fname, F_OK) != 0) return 0;  // no codes
+
+    sq_ = new ScalarQuantizer(fname);
+    if (sq_->n_pts_ != n_pts_ || sq_->dim_ != dim_) {
+        printf("Could not read the codes of %d data points from %s\n", n_pts_, fname);
+        return 1;
+    }
+    sq_err_ = sq_->get_error(p_);
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+//  the candidates are read in ascending order of their distances by codes. as
+//  the exact distance is at least the one by codes minus sq_err_ (p >= 1), the
+//  rest are skipped once it is larger than the k-th nn distance so far.
+// -----------------------------------------------------------------------------
+template <class DType>
+template <class Metric>
+void QALSH<DType>::rerank(  // re-rank candidates by exact distances
+    const DType *query,     // query point
+    const float *q_sk,      // sketch of query (allow NULL)
+    const char *dfolder,    // data folder
+    DType *data,            // buffer of data point
+    MinK_List *cand,        // candidates ranked by codes
+    MinK_List *list)        // k-NN results (return)
+{
+    float kdist = list->max_key();
+    for (int i = 0; i < cand->size(); ++i) {
+        if (cand->ith_key(i) - sq_err_ > kdist) {
+            skip_io_ += cand->size() - i;
+            break;
+        }
+        int id = cand->ith_id(i);
+        if (is_pruned(id, q_sk, kdist)) continue;
+
+        int oid = index_ != NULL ? index_[id] : id;
+        read_data_new_format<DType>(oid, dim_, B_, dfolder, data);
+        float dist = Metric::template dist<DType>(dim_, p_, kdist, data, query);
+        kdist = list->insert(dist, oid);
+        ++dist_io_;
+    }
+}
+
+// -----------------------------------------------------------------------------
+//  the b+ trees are built by a pipeline of three stages connected by bounded
+//  queues, so that projection and sort keep the cpu busy while the trees are
+//  written to disk:
+//
+//  (1) projection: threads take the next group of hash tables and calc their
+//      hash values into free buffers from a pool;
+//  (2) sort: threads sort the hash tables one by one;
+//  (3) tree write: one thread bulkloads the b+ trees and releases the buffers
+//      back to the pool.
+//
+//  the pool bounds the memory to <num_buffers> hash tables. each b+ tree only
+//  depends on its own hash table, so the trees are the same as the ones built
+//  sequentially.
 // -----------------------------------------------------------------------------
 template <class DType>
 int QALSH<DType>::bulkload(  // build b+trees by bulkloading
     const DType *data)       // data set
 {
-    Result *table = new Result[n_pts_];
     trees_ = new BTree *[m_];
+    for (int i = 0; i < m_; ++i) trees_[i] = NULL;
+
+    int num_proj = std::max(1, g_num_threads / 2);  // threads of projection
+    int num_sort = std::max(1, g_num_threads - num_proj);  // threads of sort
+    int group = std::min(PROJ_GROUP, (m_ + num_proj - 1) / num_proj);
+    int num_groups = (m_ + group - 1) / group;
+    num_proj = std::min(num_proj, num_groups);
+    num_sort = std::min(num_sort, m_);
+
+    // -------------------------------------------------------------------------
+    //  init the pool of buffers and the queues of hash tables (tid, buffer)
+    // -------------------------------------------------------------------------
+    typedef std::pair<int, Result *> Table;
+    int num_buffers = std::min(m_, num_proj * group + num_sort + 1);
+    BoundedQueue<Result *> pool(num_buffers);
+    BoundedQueue<Table> to_sort(num_buffers);
+    BoundedQueue<Table> to_write(num_buffers);
+    for (int i = 0; i < num_buffers; ++i) pool.push(new Result[n_pts_]);
+
+    std::atomic<int> next_gid(0);
+    std::atomic<int> num_proj_alive(num_proj);
+    std::atomic<int> num_sort_alive(num_sort);
+    std::vector<double> busy(num_proj + num_sort + 1, 0.0);  // busy time
+    int ret = 0;
+
+    // -------------------------------------------------------------------------
+    //  stage 1: projection
+    // -------------------------------------------------------------------------
+    auto project = [&](int thread_id) {
+        int gid = -1;
+        while ((gid = next_gid++) < num_groups) {
+            int start = gid * group;
+            int num = std::min(group, m_ - start);
+
+            Result *tables[PROJ_GROUP];
+            for (int t = 0; t < num; ++t) pool.pop(tables[t]);
+
+            double begin = get_time();
+            calc_tables(start, num, n_pts_, 0, data, tables);
+            busy[thread_id] += get_time() - begin;
+
+            for (int t = 0; t < num; ++t) to_sort.push(Table(start + t, tables[t]));
+        }
+        if (--num_proj_alive == 0) to_sort.close();
+    };
+
+    // -------------------------------------------------------------------------
+    //  stage 2: sort
+    // -------------------------------------------------------------------------
+    auto sort = [&](int thread_id) {
+        Table table;
+        while (to_sort.pop(table)) {
+            double begin = get_time();
+            sort_results(n_pts_, table.second);
+            busy[thread_id] += get_time() - begin;
+
+            to_write.push(table);
+        }
+        if (--num_sort_alive == 0) to_write.close();
+    };
+
+    // -------------------------------------------------------------------------
+    //  stage 3: tree write
+    // -------------------------------------------------------------------------
+    auto write = [&](int thread_id) {
+        Table table;
+        while (to_write.pop(table)) {
+            int tid = table.first;
+            double begin = get_time();
+            if (!ret) {
+                char fname[200];
+                get_tree_filename(tid, fname);
+                trees_[tid] = new BTree();
+                trees_[tid]->init(B_, fname);
+                if (trees_[tid]->bulkload(n_pts_, table.second)) ret = 1;
+            }
+            busy[thread_id] += get_time() - begin;
+
+            pool.push(table.second);
+        }
+    };
+
+    double start_time = get_time();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_proj; ++i) threads.emplace_back(project, i);
+    for (int i = 0; i < num_sort; ++i) threads.emplace_back(sort, num_proj + i);
+    threads.emplace_back(write, num_proj + num_sort);
+    for (auto &t : threads) t.join();
+    double wall = get_time() - start_time;
+
+    Result *buffer = NULL;
+    pool.close();
+    while (pool.pop(buffer)) delete[] buffer;
+
+    // record the utilization of each stage
+    num_proj_ = num_proj;
+    num_sort_ = num_sort;
+    wall_time_ = wall;
+    for (int i = 0; i < num_proj; ++i) proj_busy_ += busy[i];
+    for (int i = 0; i < num_sort; ++i) sort_busy_ += busy[num_proj + i];
+    write_busy_ = busy[num_proj + num_sort];
+
+    add_build_phase("projection", proj_busy_, 0);
+    add_build_phase("sort", sort_busy_, 0);
+    add_build_phase("tree_write", write_busy_, get_trees_size());
+
+    return ret;
+}
+
+// -----------------------------------------------------------------------------
+//  out-of-core indexing: the data set is read chunk by chunk within the memory
+//  cap <g_mem_cap>. each chunk is written into pages of new format, and the
+//  hash values of each table are sorted and appended as a run to a run file.
+//  the runs of each table are then merged into the bulkloading of its b+ tree.
+//  the merge gives the same order as sorting the whole table, so the b+ trees
+//  are the same as the ones built in memory.
+// -----------------------------------------------------------------------------
+template <class DType>
+int QALSH<DType>::bulkload_ext(  // build b+trees out of core
+    const char *prefix,          // prefix of data set
+    const char *dfolder)         // data folder
+{
+    trees_ = new BTree *[m_];
+    for (int i = 0; i < m_; ++i) trees_[i] = NULL;
+
+    int num_threads = std::max(1, std::min(g_num_threads, m_));
+    int group = std::min(PROJ_GROUP, (m_ + num_threads - 1) / num_threads);
+    uint64_t mem = (uint64_t)g_mem_cap * 1048576;
+
+    // -------------------------------------------------------------------------
+    //  a chunk holds the data points and, for each thread, the scratch hash
+    //  tables of a group and the buffer of radix sort. it is a multiple of the
+    //  number of points in one page, so the pages are the same as the ones of
+    //  write_data_new_form().
+    // -------------------------------------------------------------------------
+    int num = (int)floor((float)B_ / (dim_ * sizeof(DType)));
+    uint64_t size = dim_ * sizeof(DType) + (uint64_t)num_threads * (group + 1) * sizeof(Result);
+    uint64_t chunk = mem / size;
+    chunk = std::max<uint64_t>(chunk - chunk % num, num);
+    chunk = std::min<uint64_t>(chunk, n_pts_);
+
+    char fname[200];
+    sprintf(fname, "%s.ds", prefix);
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        printf("Could not open %s\n", fname);
+        return 1;
+    }
+
+    // check whether the new format data exist, and read its dimension order
+    char dpath[200];
+    sprintf(dpath, "%sdata/", dfolder);
+    bool write_pages = access(dpath, F_OK) != 0;
+    int *order = read_dim_order(dim_, dfolder);
+    if (write_pages) {
+        create_dir(dpath);
+    } else {
+        printf("New format data exist. No need writing data again.\n");
+    }
+
+    RunFile **runs = new RunFile *[m_];
     for (int i = 0; i < m_; ++i) {
-        // calc hash value and init the hash table
-        for (int j = 0; j < n_pts_; ++j) {
-            table[j].id_ = j;
-            table[j].key_ = calc_hash_value(i, &data[(uint64_t)j * dim_]);
+        get_run_filename(i, fname);
+        runs[i] = new RunFile(fname);
+    }
+
+    // -------------------------------------------------------------------------
+    //  generate the sorted runs chunk by chunk
+    // -------------------------------------------------------------------------
+    DType *data = new DType[chunk * dim_];
+    char *page = new char[B_];
+    memset(page, 0, B_ * sizeof(char));
+
+    int ret = 0;
+    int fid = 0;
+    double data_time = 0.0, proj_time = 0.0, sort_time = 0.0, run_time = 0.0;
+    std::mutex mutex;  // mutex of the times above
+
+    for (int start = 0; start < n_pts_ && !ret; start += (int)chunk) {
+        int n = std::min((int)chunk, n_pts_ - start);
+        if (fread(data, sizeof(DType), (uint64_t)n * dim_, fp) != (uint64_t)n * dim_) {
+            printf("Could not read %d data points from %s.ds\n", n_pts_, prefix);
+            ret = 1;
+            break;
         }
-        qsort(table, n_pts_, sizeof(Result), ResultComp);
+        if (order != NULL) reorder_dims<DType>(n, dim_, (const int *)order, data);
 
-        // use B+ tree to index the hash table
-        char fname[200];
-        get_tree_filename(i, fname);
-        trees_[i] = new BTree();
-        trees_[i]->init(B_, fname);
+        double start_time = get_time();
+        if (write_pages) fid = write_data_pages<DType>(n, dim_, B_, fid, data, dpath, page);
+        data_time += get_time() - start_time;
+
+        if (sk_dim_ > 0) {
+            start_time = get_time();
+            calc_sketches(n, data, &sk_data_[(uint64_t)start * sk_dim_]);
+            add_build_phase("sketch", get_time() - start_time, 0);
+        }
+        if (sq_ != NULL) {
+            start_time = get_time();
+            sq_->encode<DType>(n, start, data);
+            add_build_phase("codes", get_time() - start_time, 0);
+        }
+
+        ret = for_each_group(group, n, [&](int first, int num_tables, Result *tables) {
+            Result *table[PROJ_GROUP];
+            for (int t = 0; t < num_tables; ++t) table[t] = &tables[(uint64_t)t * n];
+
+            double t0 = get_time();
+            calc_tables(first, num_tables, n, start, data, table);
+            double t1 = get_time();
+            for (int t = 0; t < num_tables; ++t) sort_results(n, table[t]);
+            double t2 = get_time();
+            for (int t = 0; t < num_tables; ++t) {
+                if (runs[first + t]->add_run(n, table[t])) return 1;
+            }
+            double t3 = get_time();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            proj_time += t1 - t0;
+            sort_time += t2 - t1;
+            run_time += t3 - t2;
+            return 0;
+        });
+    }
+    delete[] page;
+    delete[] data;
+    if (order != NULL) delete[] order;
+    fclose(fp);
+
+    if (write_pages) add_build_phase("data_write", data_time, (uint64_t)fid * B_);
+    add_build_phase("projection", proj_time, 0);
+    add_build_phase("sort", sort_time, 0);
+    add_build_phase("run_write", run_time, (uint64_t)m_ * n_pts_ * sizeof(Result));
+
+    // -------------------------------------------------------------------------
+    //  merge the runs of each table into its b+ tree
+    // -------------------------------------------------------------------------
+    double merge_time = 0.0;
+    if (!ret) {
+        ret = for_each_group(1, 0, [&](int tid, int num_tables, Result *tables) {
+            double start_time = get_time();
+            if (runs[tid]->init_merge(mem / num_threads)) return 1;
+
+            char fname[200];
+            get_tree_filename(tid, fname);
+            trees_[tid] = new BTree();
+            trees_[tid]->init(B_, fname);
+            if (trees_[tid]->bulkload(n_pts_, runs[tid])) return 1;
+
+            delete runs[tid];
+            runs[tid] = NULL;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            merge_time += get_time() - start_time;
+            return 0;
+        });
+        add_build_phase("tree_write", merge_time, get_trees_size());
+    }
+    for (int i = 0; i < m_; ++i) {
+        if (runs[i] != NULL) delete runs[i];
+    }
+    delete[] runs;
+
+    return ret;
+}
 
-        if (trees_[i]->bulkload(n_pts_, table)) return 1;
+// -----------------------------------------------------------------------------
+//  the hash tables are independent, so they are built by <g_num_threads>
+//  threads. the tables are split into groups, and each thread takes the next
+//  unbuilt group with its own scratch hash tables, so the b+ trees are the
+//  same as the ones built by one thread.
+// -----------------------------------------------------------------------------
+template <class DType>
+template <class Func>
+int QALSH<DType>::for_each_group(  // run func on each group of hash tables
+    int group,                     // number of hash tables in a group
+    int size,                      // size of a scratch hash table
+    Func func)                     // func(start, num, tables)
+{
+    int num_groups = (m_ + group - 1) / group;
+    int num_threads = std::max(1, std::min(g_num_threads, num_groups));
+
+    std::atomic<int> next_gid(0);
+    std::vector<int> ret(num_threads, 0);
+
+    auto worker = [&](int thread_id) {
+        Result *tables = size > 0 ? new Result[(uint64_t)group * size] : NULL;
+        int gid = -1;
+        while ((gid = next_gid++) < num_groups) {
+            int start = gid * group;
+            int num = std::min(group, m_ - start);
+            if (func(start, num, tables)) {
+                ret[thread_id] = 1;
+                break;
+            }
+        }
+        if (tables != NULL) delete[] tables;
+    };
+
+    if (num_threads == 1) {
+        worker(0);
+    } else {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < num_threads; ++i) threads.emplace_back(worker, i);
+        for (auto &t : threads) t.join();
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        if (ret[i]) return 1;
     }
-    delete[] table;
     return 0;
 }
 
+// -----------------------------------------------------------------------------
+//  the projections of a group are computed tile by tile in one pass over the
+//  data, with the same order of summation as calc_hash_value().
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::calc_tables(  // calc hash values of a group of hash tables
+    int start,                   // first hash table id
+    int num,                     // number of hash tables
+    int n,                       // number of data points
+    int offset,                  // id of the first data point
+    const DType *data,           // data points
+    Result **tables)             // hash tables (num, each n) (return)
+{
+    if (proj_ == 2) {
+        // sparse hash functions: each point is hashed by sparse products
+        for (int j = 0; j < n; ++j) {
+            const DType *point = &data[(uint64_t)j * dim_];
+            for (int t = 0; t < num; ++t) {
+                tables[t][j].id_ = offset + j;
+                tables[t][j].key_ = calc_hash_value(start + t, point);
+            }
+        }
+        return;
+    }
+    float *buf = new float[(uint64_t)dim_ * PROJ_TILE];
+    float *proj = new float[num * PROJ_TILE];
+    const float *a = &a_[(uint64_t)start * dim_];
+
+    for (int j = 0; j < n; j += PROJ_TILE) {
+        int size = std::min(PROJ_TILE, n - j);
+        calc_proj_tile<DType>(size, dim_, num, a, &data[(uint64_t)j * dim_], buf, proj);
+
+        for (int t = 0; t < num; ++t) {
+            Result *table = tables[t];
+            for (int k = 0; k < size; ++k) {
+                table[j + k].id_ = offset + j + k;
+                table[j + k].key_ = proj[t * PROJ_TILE + k];
+            }
+        }
+    }
+    delete[] buf;
+    delete[] proj;
+}
+
 // -----------------------------------------------------------------------------
 template <class DType>
 QALSH<DType>::~QALSH()  // destructor
 {
     for (int i = 0; i < m_; ++i) {
-        delete trees_[i];
+        if (trees_[i] != NULL) delete trees_[i];
         trees_[i] = NULL;
     }
     delete[] trees_;
-    delete[] a_;
+    simd_free(a_);
+    delete[] hd_sign_;
+    delete[] hd_perm_;
+    delete[] hd_gauss_;
+    delete[] sp_start_;
+    delete[] sp_idx_;
+    delete[] sp_val_;
+    simd_free(sk_basis_);
+    delete[] sk_data_;
+    if (sq_ != NULL) delete sq_;
 }
 
 // -----------------------------------------------------------------------------
@@ -330,10 +1386,19 @@ QALSH<DType>::QALSH(   // constructor (load lsh index)
     : index_(index) {
     dist_io_ = 0;
     page_io_ = 0;
+    num_proj_ = num_sort_ = 0;
+    wall_time_ = proj_busy_ = sort_busy_ = write_busy_ = 0.0;
+    sk_dim_ = 0;
+    sk_basis_ = sk_data_ = NULL;
+    sq_ = NULL;
+    sq_err_ = MAXREAL;
+    skip_io_ = 0;
     strcpy(path_, path);
 
-    // read parameters from disk
+    // read parameters, sketch and codes from disk
     if (read_params()) exit(1);
+    if (read_sketch()) exit(1);
+    if (read_codes()) exit(1);
 
     // init b+ trees for k-NN search
     trees_ = new BTree *[m_];
@@ -342,6 +1407,8 @@ QALSH<DType>::QALSH(   // constructor (load lsh index)
         get_tree_filename(i, fname);
         trees_[i] = new BTree();
         trees_[i]->init_restore(fname);
+        if (g_locator == 1) trees_[i]->init_fence();
+        if (g_locator == 2) trees_[i]->init_model(PLA_ERROR);
     }
 }
 
@@ -367,8 +1434,31 @@ int QALSH<DType>::read_params()  // read parameters from disk
     fread(&c_, sizeof(float), 1, fp);
     fread(&w_, sizeof(float), 1, fp);
 
-    a_ = new float[m_ * dim_];
+    a_ = simd_alloc((uint64_t)m_ * dim_);
     fread(a_, sizeof(float), m_ * dim_, fp);
+
+    // the para of an old index ends here (dense hash functions)
+    hd_size_ = 0;
+    hd_sign_ = hd_gauss_ = NULL;
+    hd_perm_ = NULL;
+    sp_start_ = sp_idx_ = NULL;
+    sp_val_ = NULL;
+    if (fread(&proj_, sizeof(int), 1, fp) != 1) proj_ = 0;
+    if (proj_ == 2) {
+        init_sparse_lists(a_);
+        simd_free(a_);
+        a_ = NULL;
+    }
+    if (proj_ == 1) {
+        fread(&hd_size_, sizeof(int), 1, fp);
+        uint64_t size = (uint64_t)get_hd_blocks() * hd_size_;
+        hd_sign_ = new float[size];
+        hd_perm_ = new int[size];
+        hd_gauss_ = new float[size];
+        fread(hd_sign_, sizeof(float), size, fp);
+        fread(hd_perm_, sizeof(int), size, fp);
+        fread(hd_gauss_, sizeof(float), size, fp);
+    }
     fclose(fp);
     return 0;
 }
@@ -387,9 +1477,24 @@ void QALSH<DType>::display()  // display parameters
     printf("w    = %f\n", w_);
     printf("m    = %d\n", m_);
     printf("l    = %d\n", l_);
+    printf("proj = %s\n", proj_ == 2 ? "sparse" : (proj_ == 1 ? "hadamard" : "dense"));
+    printf("pca  = %d\n", sk_dim_);
+    printf("sq   = %d\n", sq_ != NULL ? sq_->bits_ : 0);
     printf("path = %s\n\n", path_);
 }
 
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::display_pipeline()  // display utilization of build pipeline
+{
+    if (wall_time_ <= 0.0) return;
+
+    printf("Pipeline of Bulkloading = %f Seconds\n", wall_time_);
+    printf("projection: %d thread(s), busy %.1f%%\n", num_proj_, 100.0 * proj_busy_ / (wall_time_ * num_proj_));
+    printf("sort:       %d thread(s), busy %.1f%%\n", num_sort_, 100.0 * sort_busy_ / (wall_time_ * num_sort_));
+    printf("tree write: 1 thread,    busy %.1f%%\n\n", 100.0 * write_busy_ / wall_time_);
+}
+
 // -----------------------------------------------------------------------------
 template <class DType>
 uint64_t QALSH<DType>::knn(  // k-NN search
@@ -397,6 +1502,27 @@ uint64_t QALSH<DType>::knn(  // k-NN search
     const DType *query,      // query point
     const char *dfolder,     // data folder
     MinK_List *list)         // k-NN results (return)
+{
+    switch (get_metric(p_)) {
+        case METRIC_L2:
+            return knn_metric<L2Metric>(top_k, query, dfolder, list);
+        case METRIC_L1:
+            return knn_metric<L1Metric>(top_k, query, dfolder, list);
+        case METRIC_L05:
+            return knn_metric<L05Metric>(top_k, query, dfolder, list);
+        default:
+            return knn_metric<LpMetric>(top_k, query, dfolder, list);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+template <class Metric>
+uint64_t QALSH<DType>::knn_metric(  // k-NN search (for one metric)
+    int top_k,                      // top-k value
+    const DType *query,             // query point
+    const char *dfolder,            // data folder
+    MinK_List *list)                // k-NN results (return)
 {
     list->reset();
 
@@ -418,8 +1544,24 @@ uint64_t QALSH<DType>::knn(  // k-NN search
     }
     init_search_params(query, q_val, lptrs, rptrs);
 
+    float *q_sk = NULL;  // sketch of query
+    if (sk_dim_ > 0) {
+        q_sk = new float[sk_dim_];
+        calc_sketches(1, query, q_sk);
+    }
+    float *q_f = NULL;       // query point (float)
+    float *x_f = NULL;       // buffer of decoded point
+    MinK_List *cand = NULL;  // candidates ranked by codes
+    if (sq_ != NULL) {
+        q_f = new float[dim_];
+        x_f = new float[dim_];
+        for (int j = 0; j < dim_; ++j) q_f[j] = (float)query[j];
+        cand = new MinK_List(std::max(top_k, (int)ceil(g_rerank * top_k)));
+    }
+
     // c-k-ANNS via dynamic collision counting framework
     int candidates = CANDIDATES + top_k - 1;  // candidates size
+    int num_cand = 0;                         // number of candidates checked
     float kdist = MAXREAL;
     float radius = find_radius(q_val, (const Page **)lptrs, (const Page **)rptrs);
     float bucket = w_ * radius / 2.0f;
@@ -453,10 +1595,15 @@ uint64_t QALSH<DType>::knn(  // k-NN search
                         int id = lptr->node_->get_entry_id(j);
                         if (++freq[id] > l_ && !checked[id]) {
                             checked[id] = true;
-                            read_data_new_format<DType>(id, dim_, B_, dfolder, data);
-                            dist = calc_lp_dist<DType>(dim_, p_, kdist, data, query);
-                            kdist = list->insert(dist, id);
-                            if (++dist_io_ >= candidates) break;
+                            if (sq_ != NULL) {
+                                check_code<Metric>(id, q_f, x_f, cand);
+                            } else if (!is_pruned(id, q_sk, kdist)) {
+                                read_data_new_format<DType>(id, dim_, B_, dfolder, data);
+                                dist = Metric::template dist<DType>(dim_, p_, kdist, data, query);
+                                kdist = list->insert(dist, id);
+                                ++dist_io_;
+                            }
+                            if (++num_cand >= candidates) break;
                         }
                     }
                     update_left_buffer(rptr, lptr);
@@ -469,10 +1616,15 @@ uint64_t QALSH<DType>::knn(  // k-NN search
                         int id = rptr->node_->get_entry_id(j);
                         if (++freq[id] > l_ && !checked[id]) {
                             checked[id] = true;
-                            read_data_new_format<DType>(id, dim_, B_, dfolder, data);
-                            dist = calc_lp_dist<DType>(dim_, p_, kdist, data, query);
-                            kdist = list->insert(dist, id);
-                            if (++dist_io_ >= candidates) break;
+                            if (sq_ != NULL) {
+                                check_code<Metric>(id, q_f, x_f, cand);
+                            } else if (!is_pruned(id, q_sk, kdist)) {
+                                read_data_new_format<DType>(id, dim_, B_, dfolder, data);
+                                dist = Metric::template dist<DType>(dim_, p_, kdist, data, query);
+                                kdist = list->insert(dist, id);
+                                ++dist_io_;
+                            }
+                            if (++num_cand >= candidates) break;
                         }
                     }
                     update_right_buffer(lptr, rptr);
@@ -480,18 +1632,21 @@ uint64_t QALSH<DType>::knn(  // k-NN search
                     flag[i] = false;
                     ++num_flag;
                 }
-                if (num_flag >= m_ || dist_io_ >= candidates) break;
+                if (num_flag >= m_ || num_cand >= candidates) break;
             }
-            if (num_flag >= m_ || dist_io_ >= candidates) break;
+            if (num_flag >= m_ || num_cand >= candidates) break;
         }
-        // step 3: stop conditions 1 & 2
-        if (kdist < c_ * radius && dist_io_ >= top_k) break;
-        if (dist_io_ >= candidates) break;
+        // step 3: stop conditions 1 & 2 (by the k-th nn distance of codes)
+        if (sq_ != NULL) kdist = cand->ith_key(top_k - 1);
+        if (kdist < c_ * radius && num_cand >= top_k) break;
+        if (num_cand >= candidates) break;
 
         // step 4: auto-update <radius>
         radius = update_radius(radius, q_val, (const Page **)lptrs, (const Page **)rptrs);
         bucket = radius * w_ / 2.0f;
     }
+    if (sq_ != NULL) rerank<Metric>(query, q_sk, dfolder, data, cand, list);
+
     // release space
     delete_tree_ptr(lptrs, rptrs);
     delete[] freq;
@@ -499,6 +1654,12 @@ uint64_t QALSH<DType>::knn(  // k-NN search
     delete[] flag;
     delete[] q_val;
     delete[] data;
+    if (q_sk != NULL) delete[] q_sk;
+    if (sq_ != NULL) {
+        delete[] q_f;
+        delete[] x_f;
+        delete cand;
+    }
 
     return page_io_ + dist_io_;
 }
@@ -510,6 +1671,27 @@ uint64_t QALSH<DType>::knn2(  // k-NN search
     const DType *query,       // query point
     const char *dfolder,      // data folder
     MinK_List *list)          // k-NN results (return)
+{
+    switch (get_metric(p_)) {
+        case METRIC_L2:
+            return knn2_metric<L2Metric>(top_k, query, dfolder, list);
+        case METRIC_L1:
+            return knn2_metric<L1Metric>(top_k, query, dfolder, list);
+        case METRIC_L05:
+            return knn2_metric<L05Metric>(top_k, query, dfolder, list);
+        default:
+            return knn2_metric<LpMetric>(top_k, query, dfolder, list);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+template <class Metric>
+uint64_t QALSH<DType>::knn2_metric(  // k-NN search (for one metric)
+    int top_k,                       // top-k value
+    const DType *query,              // query point
+    const char *dfolder,             // data folder
+    MinK_List *list)                 // k-NN results (return)
 {
     // initialize parameters for c-k-ANNS
     int *freq = new int[n_pts_];
@@ -531,8 +1713,24 @@ uint64_t QALSH<DType>::knn2(  // k-NN search
     }
     init_search_params(query, q_val, lptrs, rptrs);
 
+    float *q_sk = NULL;  // sketch of query
+    if (sk_dim_ > 0) {
+        q_sk = new float[sk_dim_];
+        calc_sketches(1, query, q_sk);
+    }
+    float *q_f = NULL;       // query point (float)
+    float *x_f = NULL;       // buffer of decoded point
+    MinK_List *cand = NULL;  // candidates ranked by codes
+    if (sq_ != NULL) {
+        q_f = new float[dim_];
+        x_f = new float[dim_];
+        for (int j = 0; j < dim_; ++j) q_f[j] = (float)query[j];
+        cand = new MinK_List(std::max(top_k, (int)ceil(g_rerank * top_k)));
+    }
+
     // c-k-ANNS via dynamic collision counting framework
     int candidates = CANDIDATES + top_k - 1;  // candidates size
+    int num_cand = 0;                         // number of candidates checked
     int num_range = 0;                        // used for search range bound
 
     float kdist = list->max_key();
@@ -569,11 +1767,16 @@ uint64_t QALSH<DType>::knn2(  // k-NN search
                         int id = lptr->node_->get_entry_id(j);
                         if (++freq[id] > l_ && !checked[id]) {
                             checked[id] = true;
-                            int oid = index_[id];
-                            read_data_new_format<DType>(oid, dim_, B_, dfolder, data);
-                            dist = calc_lp_dist<DType>(dim_, p_, kdist, data, query);
-                            kdist = list->insert(dist, oid);
-                            if (++dist_io_ >= candidates) break;
+                            if (sq_ != NULL) {
+                                check_code<Metric>(id, q_f, x_f, cand);
+                            } else if (!is_pruned(id, q_sk, kdist)) {
+                                int oid = index_[id];
+                                read_data_new_format<DType>(oid, dim_, B_, dfolder, data);
+                                dist = Metric::template dist<DType>(dim_, p_, kdist, data, query);
+                                kdist = list->insert(dist, oid);
+                                ++dist_io_;
+                            }
+                            if (++num_cand >= candidates) break;
                         }
                     }
                     update_left_buffer(rptr, lptr);
@@ -586,11 +1789,16 @@ uint64_t QALSH<DType>::knn2(  // k-NN search
                         int id = rptr->node_->get_entry_id(j);
                         if (++freq[id] > l_ && !checked[id]) {
                             checked[id] = true;
-                            int oid = index_[id];
-                            read_data_new_format<DType>(oid, dim_, B_, dfolder, data);
-                            dist = calc_lp_dist<DType>(dim_, p_, kdist, data, query);
-                            kdist = list->insert(dist, oid);
-                            if (++dist_io_ >= candidates) break;
+                            if (sq_ != NULL) {
+                                check_code<Metric>(id, q_f, x_f, cand);
+                            } else if (!is_pruned(id, q_sk, kdist)) {
+                                int oid = index_[id];
+                                read_data_new_format<DType>(oid, dim_, B_, dfolder, data);
+                                dist = Metric::template dist<DType>(dim_, p_, kdist, data, query);
+                                kdist = list->insert(dist, oid);
+                                ++dist_io_;
+                            }
+                            if (++num_cand >= candidates) break;
                         }
                     }
                     update_right_buffer(lptr, rptr);
@@ -603,18 +1811,20 @@ uint64_t QALSH<DType>::knn2(  // k-NN search
                     }
                 }
                 if (num_bucket >= m_ || num_range >= m_) break;
-                if (dist_io_ >= candidates) break;
+                if (num_cand >= candidates) break;
             }
             if (num_bucket >= m_ || num_range >= m_) break;
-            if (dist_io_ >= candidates) break;
+            if (num_cand >= candidates) break;
         }
         // step 3: stop conditions 1 & 2
-        if (dist_io_ >= candidates || num_range >= m_) break;
+        if (num_cand >= candidates || num_range >= m_) break;
 
         // step 4: auto-update <radius>
         radius = update_radius(radius, q_val, (const Page **)lptrs, (const Page **)rptrs);
         bucket = radius * w_ / 2.0f;
     }
+    if (sq_ != NULL) rerank<Metric>(query, q_sk, dfolder, data, cand, list);
+
     // release space
     delete_tree_ptr(lptrs, rptrs);
     delete[] freq;
@@ -623,6 +1833,12 @@ uint64_t QALSH<DType>::knn2(  // k-NN search
     delete[] range_flag;
     delete[] q_val;
     delete[] data;
+    if (q_sk != NULL) delete[] q_sk;
+    if (sq_ != NULL) {
+        delete[] q_f;
+        delete[] x_f;
+        delete cand;
+    }
 
     return page_io_ + dist_io_;
 }
@@ -654,19 +1870,35 @@ void QALSH<DType>::init_search_params(  // init parameters for k-NN search
     int block = -1;  // variables for index node
     int follow = -1;
     bool lescape = false;
-    int pos = -1;  // variables for leaf node
-    int increment = -1;
-    int num_entries = -1;
 
+    calc_hash_values(query, q_val);
     for (int i = 0; i < m_; ++i) {
-        float q_v = calc_hash_value(i, query);
+        float q_v = q_val[i];
         BTree *tree = trees_[i];
         Page *lptr = lptrs[i];
         Page *rptr = rptrs[i];
 
-        q_val[i] = q_v;
         block = tree->root_;
-        if (block > 1) {
+        if (block > 1 && g_locator == 1 && tree->has_fence()) {
+            // -----------------------------------------------------------------
+            //  at least two levels in the B+ Tree: use the fence directory in
+            //  memory to find the leaf node directly (no index node i/o)
+            // -----------------------------------------------------------------
+            follow = tree->find_leaf_by_key(q_v);
+            lescape = (follow < 0);
+            block = tree->fence_block_[lescape ? 0 : follow];
+
+            init_leaf_buffer(load_leaf(tree, block), NULL, lescape, q_v, lptr, rptr);
+        } else if (block > 1 && g_locator == 2 && tree->has_model()) {
+            // -----------------------------------------------------------------
+            //  at least two levels in the B+ Tree: use the learned index to
+            //  predict the leaf node and correct it by its siblings
+            // -----------------------------------------------------------------
+            BLeafNode *right = NULL;
+            BLeafNode *leaf = locate_leaf_by_model(tree, q_v, lescape, right);
+
+            init_leaf_buffer(leaf, right, lescape, q_v, lptr, rptr);
+        } else if (block > 1) {
             // -----------------------------------------------------------------
             //  at least two levels in the B+ Tree: index node and lead node
             // -----------------------------------------------------------------
@@ -716,124 +1948,13 @@ void QALSH<DType>::init_search_params(  // init parameters for k-NN search
                 lescape = true;
                 follow = 0;
             }
-
-            if (lescape) {
-                // -------------------------------------------------------------
-                //  only init right buffer
-                // -------------------------------------------------------------
-                block = index_node->get_son(0);
-                rptr->node_ = new BLeafNode();
-                rptr->node_->init_restore(tree, block);
-                rptr->key_pos_ = 0;
-                rptr->idx_pos_ = 0;
-
-                increment = rptr->node_->get_increment();
-                num_entries = rptr->node_->get_num_entries();
-                if (increment > num_entries)
-                    rptr->size_ = num_entries;
-                else
-                    rptr->size_ = increment;
-
-                ++page_io_;
-            } else {
-                // -------------------------------------------------------------
-                //  init left buffer
-                // -------------------------------------------------------------
-                block = index_node->get_son(follow);
-                lptr->node_ = new BLeafNode();
-                lptr->node_->init_restore(tree, block);
-
-                pos = lptr->node_->find_position_by_key(q_v);
-                if (pos < 0) pos = 0;
-                lptr->key_pos_ = pos;
-
-                increment = lptr->node_->get_increment();
-                if (pos == lptr->node_->get_num_keys() - 1) {
-                    num_entries = lptr->node_->get_num_entries();
-
-                    lptr->idx_pos_ = num_entries - 1;
-                    lptr->size_ = num_entries - pos * increment;
-                } else {
-                    lptr->idx_pos_ = pos * increment + increment - 1;
-                    lptr->size_ = increment;
-                }
-                ++page_io_;
-
-                // -------------------------------------------------------------
-                //  init right buffer
-                // -------------------------------------------------------------
-                if (pos < lptr->node_->get_num_keys() - 1) {
-                    rptr->node_ = lptr->node_;
-                    rptr->key_pos_ = pos + 1;
-                    rptr->idx_pos_ = (pos + 1) * increment;
-
-                    if ((pos + 1) == rptr->node_->get_num_keys() - 1) {
-                        num_entries = rptr->node_->get_num_entries();
-                        rptr->size_ = num_entries - (pos + 1) * increment;
-                    } else {
-                        rptr->size_ = increment;
-                    }
-                } else {
-                    rptr->node_ = lptr->node_->get_right_sibling();
-                    if (rptr->node_) {
-                        rptr->key_pos_ = 0;
-                        rptr->idx_pos_ = 0;
-
-                        increment = rptr->node_->get_increment();
-                        num_entries = rptr->node_->get_num_entries();
-                        if (increment > num_entries)
-                            rptr->size_ = num_entries;
-                        else
-                            rptr->size_ = increment;
-
-                        ++page_io_;
-                    }
-                }
-            }
+            block = index_node->get_son(follow);
+            init_leaf_buffer(load_leaf(tree, block), NULL, lescape, q_v, lptr, rptr);
         } else {
             // -----------------------------------------------------------------
             //  only one level in the B+ Tree: one lead node
-            //  (1) init left buffer
-            // -----------------------------------------------------------------
-            lptr->node_ = new BLeafNode();
-            lptr->node_->init_restore(tree, block);
-
-            pos = lptr->node_->find_position_by_key(q_v);
-            if (pos < 0) pos = 0;
-            lptr->key_pos_ = pos;
-
-            increment = lptr->node_->get_increment();
-            if (pos == lptr->node_->get_num_keys() - 1) {
-                num_entries = lptr->node_->get_num_entries();
-
-                lptr->idx_pos_ = num_entries - 1;
-                lptr->size_ = num_entries - pos * increment;
-            } else {
-                lptr->idx_pos_ = pos * increment + increment - 1;
-                lptr->size_ = increment;
-            }
-            ++page_io_;
-
-            // -----------------------------------------------------------------
-            //  (2) init right buffer
             // -----------------------------------------------------------------
-            if (pos < lptr->node_->get_num_keys() - 1) {
-                rptr->node_ = lptr->node_;
-                rptr->key_pos_ = pos + 1;
-                rptr->idx_pos_ = (pos + 1) * increment;
-
-                if ((pos + 1) == rptr->node_->get_num_keys() - 1) {
-                    num_entries = rptr->node_->get_num_entries();
-                    rptr->size_ = num_entries - (pos + 1) * increment;
-                } else {
-                    rptr->size_ = increment;
-                }
-            } else {
-                rptr->node_ = NULL;
-                rptr->key_pos_ = -1;
-                rptr->idx_pos_ = -1;
-                rptr->size_ = -1;
-            }
+            init_leaf_buffer(load_leaf(tree, block), NULL, false, q_v, lptr, rptr);
         }
         if (index_node != NULL) {
             delete index_node;
@@ -842,6 +1963,152 @@ void QALSH<DType>::init_search_params(  // init parameters for k-NN search
     }
 }
 
+// -----------------------------------------------------------------------------
+template <class DType>
+BLeafNode *QALSH<DType>::load_leaf(  // load a leaf node from disk
+    BTree *tree,                     // b+ tree
+    int block)                       // block of leaf node
+{
+    BLeafNode *leaf = new BLeafNode();
+    leaf->init_restore(tree, block);
+    ++page_io_;
+
+    return leaf;
+}
+
+// -----------------------------------------------------------------------------
+//  the learned index predicts a leaf within a bounded error. the prediction is
+//  corrected by moving to the left sibling while its first key is larger than
+//  the key of query, or to the right sibling while the first key of the right
+//  sibling is less than or equal to the key of query. the right sibling only
+//  needs to be checked when the key of query is not smaller than the last key
+//  of this leaf, and it is returned by <right> for the right buffer.
+// -----------------------------------------------------------------------------
+template <class DType>
+BLeafNode *QALSH<DType>::locate_leaf_by_model(  // locate leaf by learned index
+    BTree *tree,                                // b+ tree
+    float q_v,                                  // hash value of query
+    bool &lescape,                              // no left buffer (return)
+    BLeafNode *&right)                          // right sibling (return)
+{
+    int block = tree->predict_leaf_by_key(q_v);
+    lescape = (block < 0);
+    right = NULL;
+    if (lescape) return load_leaf(tree, tree->get_first_leaf());
+
+    BLeafNode *leaf = load_leaf(tree, block);
+    bool move_left = false;
+    while (leaf->get_key_of_node() > q_v) {
+        BLeafNode *left = leaf->get_left_sibling();
+        ++page_io_;
+        delete leaf;
+        leaf = left;
+        move_left = true;
+    }
+    if (move_left) return leaf;
+
+    while (q_v >= leaf->get_key(leaf->get_num_keys() - 1)) {
+        right = leaf->get_right_sibling();
+        if (right == NULL) break;
+        ++page_io_;
+
+        if (right->get_key_of_node() > q_v) break;
+        delete leaf;
+        leaf = right;
+        right = NULL;
+    }
+    return leaf;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void QALSH<DType>::init_leaf_buffer(  // init buffers from a leaf node
+    BLeafNode *leaf,                  // leaf node (loaded)
+    BLeafNode *right,                 // right sibling of leaf (loaded or NULL)
+    bool lescape,                     // query is smaller than all keys
+    float q_v,                        // hash value of query
+    Page *lptr,                       // left  buffer (return)
+    Page *rptr)                       // right buffer (return)
+{
+    int pos = -1;  // variables for leaf node
+    int increment = -1;
+    int num_entries = -1;
+
+    if (lescape) {
+        // ---------------------------------------------------------------------
+        //  only init right buffer
+        // ---------------------------------------------------------------------
+        if (right != NULL) delete right;
+        rptr->node_ = leaf;
+        rptr->key_pos_ = 0;
+        rptr->idx_pos_ = 0;
+
+        increment = rptr->node_->get_increment();
+        num_entries = rptr->node_->get_num_entries();
+        if (increment > num_entries)
+            rptr->size_ = num_entries;
+        else
+            rptr->size_ = increment;
+        return;
+    }
+
+    // -------------------------------------------------------------------------
+    //  init left buffer
+    // -------------------------------------------------------------------------
+    lptr->node_ = leaf;
+
+    pos = lptr->node_->find_position_by_key(q_v);
+    if (pos < 0) pos = 0;
+    lptr->key_pos_ = pos;
+
+    increment = lptr->node_->get_increment();
+    if (pos == lptr->node_->get_num_keys() - 1) {
+        num_entries = lptr->node_->get_num_entries();
+
+        lptr->idx_pos_ = num_entries - 1;
+        lptr->size_ = num_entries - pos * increment;
+    } else {
+        lptr->idx_pos_ = pos * increment + increment - 1;
+        lptr->size_ = increment;
+    }
+
+    // -------------------------------------------------------------------------
+    //  init right buffer
+    // -------------------------------------------------------------------------
+    if (pos < lptr->node_->get_num_keys() - 1) {
+        if (right != NULL) delete right;
+        rptr->node_ = lptr->node_;
+        rptr->key_pos_ = pos + 1;
+        rptr->idx_pos_ = (pos + 1) * increment;
+
+        if ((pos + 1) == rptr->node_->get_num_keys() - 1) {
+            num_entries = rptr->node_->get_num_entries();
+            rptr->size_ = num_entries - (pos + 1) * increment;
+        } else {
+            rptr->size_ = increment;
+        }
+    } else {
+        // the right sibling is NULL if this leaf is the last (or only) one
+        if (right != NULL) {
+            rptr->node_ = right;
+        } else {
+            rptr->node_ = lptr->node_->get_right_sibling();
+            if (rptr->node_) ++page_io_;
+        }
+        if (rptr->node_) {
+            rptr->key_pos_ = 0;
+            rptr->idx_pos_ = 0;
+
+            increment = rptr->node_->get_increment();
+            num_entries = rptr->node_->get_num_entries();
+            if (increment > num_entries)
+                rptr->size_ = num_entries;
+            else
+                rptr->size_ = increment;
+        }
+    }
+}
+
 // -----------------------------------------------------------------------------
 template <class DType>
 float QALSH<DType>::find_radius(  // find proper radius
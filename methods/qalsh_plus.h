@@ -12,6 +12,7 @@
 #include "kd_tree.h"
 #include "pri_queue.h"
 #include "qalsh.h"
+#include "simd.h"
 #include "util.h"
 
 namespace nns {
@@ -43,6 +44,16 @@ class QALSH_PLUS {
     // -------------------------------------------------------------------------
     inline int get_num_blocks() { return n_blocks_; }
 
+    // -------------------------------------------------------------------------
+    inline bool has_lower_bound() { return lsh_->sk_dim_ > 0 || lsh_->sq_ != NULL; }
+
+    // -------------------------------------------------------------------------
+    uint64_t get_skip_io() {  // get io avoided by lower bounds (all queries)
+        uint64_t ret = lsh_->skip_io_;
+        for (int i = 0; i < n_blocks_; ++i) ret += blocks_[i]->skip_io_;
+        return ret;
+    }
+
     // -------------------------------------------------------------------------
     void display();  // display parameters
 
@@ -168,7 +179,9 @@ QALSH_PLUS<DType>::QALSH_PLUS(  // constructor (build index)
     memset(sample_index_to_block_, -1, n_pts_);
 
     // kd-tree partition (get index_, n_blocks_, and block_size_)
+    double start_time = get_time();
     kd_tree_partition(leaf, data);
+    add_build_phase("kd_partition", get_time() - start_time, 0);
 
     // init sample_index_ and build qalsh for each block
     int n_sample_pts = n_blocks_ * n_samples_;
@@ -190,8 +203,10 @@ QALSH_PLUS<DType>::QALSH_PLUS(  // constructor (build index)
 
         // get sample data index (representative data) by drusilla select
         assert(n_blk > n_samples_);
+        start_time = get_time();
         drusilla_select(n_blk, L, M, index, (const DType *)blk_data, sample_index,
                         &sample_data[(uint64_t)count * dim_]);
+        add_build_phase("drusilla_select", get_time() - start_time, 0);
 
         for (int j = 0; j < n_samples_; ++j) {
             sample_index_to_block_[sample_index[j]] = i;
@@ -202,8 +217,12 @@ QALSH_PLUS<DType>::QALSH_PLUS(  // constructor (build index)
         sprintf(block_path, "%s%d/", path_, i);
         create_dir(block_path);
 
+        start_time = get_time();
+        g_build_scope = "block_build";
         QALSH<DType> *lsh = new QALSH<DType>(n_blk, dim_, B, p, zeta, c, (const DType *)blk_data, block_path, index);
         blocks_.push_back(lsh);
+        g_build_scope.clear();
+        add_build_phase("block_build", get_time() - start_time, 0);
         delete[] blk_data;
 
         // update parameters
@@ -217,11 +236,20 @@ QALSH_PLUS<DType>::QALSH_PLUS(  // constructor (build index)
     sprintf(sample_path, "%ssample/", path_);
     create_dir(sample_path);
 
+    start_time = get_time();
+    g_build_scope = "sample_index";
     lsh_ = new QALSH<DType>(n_sample_pts, dim_, B, p, zeta, c, (const DType *)sample_data, sample_path,
                             (const int *)sample_index_);
+    g_build_scope.clear();
+    add_build_phase("sample_index", get_time() - start_time, 0);
 
     // write parameters to disk
+    start_time = get_time();
     if (write_params()) exit(1);
+
+    char fname[200];
+    sprintf(fname, "%spara", path_);
+    add_build_phase("param_write", get_time() - start_time, get_file_size(fname));
     delete[] sample_data;
 }
 
@@ -277,12 +305,13 @@ void QALSH_PLUS<DType>::drusilla_select(  // drusilla select
     int max_id = -1;
     float max_norm = MINREAL;
     float *norm = new float[n];
-    float *shift_data = new float[(uint64_t)n * dim_];
+    float *shift_data = simd_alloc((uint64_t)n * dim_);
 
     calc_shift_data(n, data, max_id, max_norm, norm, shift_data);
 
     // drusilla select
     float *proj = new float[dim_];
+    float *offsets = new float[n];
     Result *score = new Result[n];
     bool *close_angle = new bool[n];
     float offset = -1.0f;
@@ -292,14 +321,15 @@ void QALSH_PLUS<DType>::drusilla_select(  // drusilla select
         // select the projection vector with largest norm and normalize it
         select_proj(norm[max_id], &shift_data[(uint64_t)max_id * dim_], proj);
 
-        // calculate offsets and distortions
+        // calculate offsets (of all points at once) and distortions
+        simd_gemv<float>(n, dim_, shift_data, proj, offsets);
         for (int j = 0; j < n; ++j) {
             close_angle[j] = false;
             score[j].id_ = j;
 
             if (norm[j] > 0.0f) {
                 const float *tmp = &shift_data[(uint64_t)j * dim_];
-                offset = calc_inner_product<float>(dim_, (const float *)proj, tmp);
+                offset = offsets[j];
                 distortion = calc_distortion(offset, (const float *)proj, tmp);
                 score[j].key_ = offset * offset - distortion;
 
@@ -313,7 +343,7 @@ void QALSH_PLUS<DType>::drusilla_select(  // drusilla select
             }
         }
         // collect the points that are well-represented by this projection
-        qsort(score, n, sizeof(Result), ResultCompDesc);
+        sort_results_desc(n, score);
         for (int j = 0; j < M; ++j) {
             int id = score[j].id_;
             int loc = i * M + j;
@@ -338,9 +368,10 @@ void QALSH_PLUS<DType>::drusilla_select(  // drusilla select
     // release space
     delete[] close_angle;
     delete[] score;
+    delete[] offsets;
     delete[] proj;
     delete[] norm;
-    delete[] shift_data;
+    simd_free(shift_data);
 }
 
 // -----------------------------------------------------------------------------
@@ -608,7 +639,7 @@ uint64_t QALSH_PLUS<DType>::get_block_order(  // get block order
         int bid = sample_index_to_block_[list->ith_id(i)];
         pair[bid].key_ += 1.0f;
     }
-    qsort(pair, n_blocks_, sizeof(Result), ResultCompDesc);
+    sort_results_desc(n_blocks_, pair);
 
     for (int i = 0; i < nb; ++i) {
         // if (fabs(pair[i].key_) < FLOATZERO) break;
@@ -125,6 +125,150 @@ float p_stable(   // r.v. from p-satble distr.
     return gamma * x + delta;
 }
 
+// -----------------------------------------------------------------------------
+//  the state of xoshiro256** is expanded from the seed by splitmix64, as is
+//  recommended by the authors
+// -----------------------------------------------------------------------------
+Xoshiro::Xoshiro(   // constructor
+    uint64_t seed)  // seed of stream
+{
+    for (int i = 0; i < 4; ++i) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        s_[i] = z ^ (z >> 31);
+    }
+}
+
+// -----------------------------------------------------------------------------
+//  use the high 24 bits of each number and shift by half a step, so that the
+//  r.v. are never 0 or 1 and the transforms below need no rejection
+// -----------------------------------------------------------------------------
+void Xoshiro::uniform(  // n r.v. from Uniform(0, 1) (open interval)
+    int n,              // number of r.v.
+    float *u)           // r.v. (return)
+{
+    const float scale = 1.0f / 16777216.0f;
+    for (int i = 0; i < n; ++i) {
+        u[i] = ((float)(next() >> 40) + 0.5f) * scale;
+    }
+}
+
+// -----------------------------------------------------------------------------
+//  the batched generators draw the uniform r.v. of a batch at first, and then
+//  apply the transform in a loop without rejection or branches
+// -----------------------------------------------------------------------------
+void gaussian(     // n r.v. from Gaussian(mean, sigma)
+    Xoshiro &rng,  // random stream
+    int n,         // number of r.v.
+    float mu,      // mean (location)
+    float sigma,   // stanard deviation (scale > 0)
+    float *x)      // r.v. (return)
+{
+    // use both outputs of Box-Muller transform
+    float u[2 * RNG_BATCH];
+    for (int i = 0; i < n; i += 2 * RNG_BATCH) {
+        int num = std::min(2 * RNG_BATCH, n - i);
+        int pairs = (num + 1) / 2;
+        rng.uniform(2 * pairs, u);
+
+        for (int j = 0; j < pairs; ++j) {
+            float r = sigma * sqrtf(-2.0f * logf(u[j]));
+            float t = 2.0f * PI * u[pairs + j];
+            u[j] = mu + r * cosf(t);
+            u[pairs + j] = mu + r * sinf(t);
+        }
+        for (int j = 0; j < num; ++j) {
+            x[i + j] = u[(j >> 1) + (j & 1) * pairs];
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+void cauchy(       // n r.v. from Cauchy(gamma, delta)
+    Xoshiro &rng,  // random stream
+    int n,         // number of r.v.
+    float gamma,   // scale factor (gamma > 0)
+    float delta,   // location
+    float *x)      // r.v. (return)
+{
+    rng.uniform(n, x);
+    for (int i = 0; i < n; ++i) {
+        x[i] = gamma * tanf(PI * (x[i] - 0.5f)) + delta;
+    }
+}
+
+// -----------------------------------------------------------------------------
+void levy(         // n r.v. from Levy(gamma, delta)
+    Xoshiro &rng,  // random stream
+    int n,         // number of r.v.
+    float gamma,   // scale factor (gamma > 0)
+    float delta,   // location
+    float *x)      // r.v. (return)
+{
+    // Levy(1, 0) is 1 / g^2 for g ~ N(0, 1), and g^2 = -2 log(u1) cos^2(t);
+    // cos^2(t) is clamped so that a (rare) zero g gives a large finite r.v.
+    float u[2 * RNG_BATCH];
+    for (int i = 0; i < n; i += RNG_BATCH) {
+        int num = std::min(RNG_BATCH, n - i);
+        rng.uniform(2 * num, u);
+
+        for (int j = 0; j < num; ++j) {
+            float c = cosf(2.0f * PI * u[num + j]);
+            float g2 = std::max(-2.0f * logf(u[j]) * c * c, FLOATZERO * FLOATZERO);
+            x[i + j] = gamma / g2 + delta;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+void p_stable(     // n r.v. from p-stable distr.
+    Xoshiro &rng,  // random stream
+    int n,         // number of r.v.
+    float p,       // p value, where p in (0,2]
+    float zeta,    // symmetric factor (zeta in [-1, 1])
+    float gamma,   // scale factor (gamma > 0)
+    float delta,   // location
+    float *x)      // r.v. (return)
+{
+    bool symmetric = fabs(zeta) < FLOATZERO;
+    bool p_is_one = fabs(p - 1.0f) < FLOATZERO;
+    float t0 = p_is_one ? PI / 2.0f : atanf(zeta * tanf(PI * p / 2.0f)) / p;
+    float e1 = 1.0f / p;
+    float e2 = (1.0f - p) / p;
+    float c0 = powf(cosf(p * t0), -e1);
+
+    float u[2 * RNG_BATCH];
+    for (int i = 0; i < n; i += RNG_BATCH) {
+        int num = std::min(RNG_BATCH, n - i);
+        rng.uniform(2 * num, u);
+        float *theta = u;
+        float *w = u + num;
+
+        for (int j = 0; j < num; ++j) {
+            theta[j] = PI * (theta[j] - 0.5f);
+            w[j] = -logf(w[j]);
+        }
+        // the same formulas as p_stable() above (t0 = 0 if symmetric)
+        if (symmetric && p_is_one) {
+            for (int j = 0; j < num; ++j) x[i + j] = tanf(theta[j]);
+        } else if (p_is_one) {
+            for (int j = 0; j < num; ++j) {
+                float t1 = (t0 + zeta * theta[j]) * tanf(theta[j]);
+                float t2 = (t0 * w[j] * cosf(theta[j])) / (t0 + zeta * theta[j]);
+                x[i + j] = (t1 - zeta * logf(t2)) / t0;
+            }
+        } else {
+            for (int j = 0; j < num; ++j) {
+                float t1 = sinf(p * (t0 + theta[j])) * c0 * powf(cosf(theta[j]), -e1);
+                float t3 = cosf(p * t0 + (p - 1.0f) * theta[j]) / w[j];
+                x[i + j] = t1 * powf(t3, e2);
+            }
+        }
+        for (int j = 0; j < num; ++j) x[i + j] = gamma * x[i + j] + delta;
+    }
+}
+
 // -----------------------------------------------------------------------------
 //  functions used for calculating probability distribution function (pdf) and
 //  cumulative distribution function (cdf).
@@ -385,6 +529,66 @@ void new_stable_prob(  // calc new stable probability
     query2 = NULL;
 }
 
+// -----------------------------------------------------------------------------
+//  calc the new collision probability Pr[|X| < x] for X ~ S(p, zeta, 1, 0) of
+//  p_stable() by numerical integration instead of Monte Carlo.
+//
+//  by the Chambers-Mallows-Stuck representation used in p_stable(), X is a
+//  function of theta ~ U(-PI/2, PI/2) and w ~ Exp(1). for a fixed theta, X is
+//  monotone in w, so Pr[|X| < x | theta] has a closed form in w:
+//
+//  p != 1: X = K(theta) * w^{(p-1)/p}, thus
+//          p < 1: Pr = exp(-(|K| / x)^{p/(1-p)})
+//          p > 1: Pr = 1 - exp(-(x / |K|)^{p/(p-1)})
+//  p == 1: X = A(theta) - (2 * zeta / PI) * log(w), thus Pr is the mass of
+//          Exp(1) on an interval of w (X = tan(theta) if zeta == 0)
+//
+//  the remaining 1-D integral over theta is computed by the midpoint rule.
+// -----------------------------------------------------------------------------
+float new_stable_prob(  // calc new stable probability (deterministic)
+    float p,            // the p value, where p in (0, 2]
+    float zeta,         // symmetric factor (zeta in [-1, 1])
+    float x,            // x = w / (2 * r)
+    int num)            // number of steps of quadrature
+{
+    if (x <= 0.0f) return 0.0f;
+
+    const double pi = 3.14159265358979323846;
+    double step = pi / num;
+    double sum = 0.0;
+    bool p_is_one = fabs(p - 1.0f) < FLOATZERO;
+    double t0 = p_is_one ? pi / 2.0 : atan(zeta * tan(pi * p / 2.0)) / p;
+
+    for (int i = 0; i < num; ++i) {
+        double theta = -pi / 2.0 + (i + 0.5) * step;
+        double prob = 0.0;  // Pr[|X| < x | theta]
+
+        if (p_is_one && fabs(zeta) < FLOATZERO) {
+            prob = fabs(tan(theta)) < x ? 1.0 : 0.0;
+        } else if (p_is_one) {
+            // t0 * X = a - zeta * log(w), so log(w) lies in (lo, hi)
+            double a = (t0 + zeta * theta) * tan(theta) - zeta * log(t0 * cos(theta) / (t0 + zeta * theta));
+            double lo = (a - t0 * x) / zeta;
+            double hi = (a + t0 * x) / zeta;
+            if (lo > hi) std::swap(lo, hi);
+            prob = exp(-exp(lo)) - exp(-exp(hi));
+        } else {
+            double k = sin(p * (t0 + theta)) / pow(cos(p * t0) * cos(theta), 1.0 / p) *
+                       pow(cos(p * t0 + (p - 1.0) * theta), (1.0 - p) / p);
+            k = fabs(k);
+            if (k < 1e-300) {
+                prob = 1.0;
+            } else if (p < 1.0f) {
+                prob = exp(-pow(k / x, p / (1.0 - p)));
+            } else {
+                prob = 1.0 - exp(-pow(x / k, p / (p - 1.0)));
+            }
+        }
+        sum += prob;
+    }
+    return (float)(sum / num);
+}
+
 // -----------------------------------------------------------------------------
 //  probability vs. w for a fixed ratio c
 // -----------------------------------------------------------------------------
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 
@@ -45,6 +46,85 @@ float p_stable(    // r.v. from p-satble distr.
     float gamma,   // scale factor (gamma > 0)
     float delta);  // location
 
+// -----------------------------------------------------------------------------
+//  Xoshiro: the xoshiro256** generator of Blackman and Vigna. each instance is
+//  an independent stream determined by its seed, which is used to generate the
+//  r.v. of one hash table in batch, so that the tables are reproducible no
+//  matter in which order (or by which thread) they are generated.
+// -----------------------------------------------------------------------------
+class Xoshiro {
+   public:
+    Xoshiro(             // constructor
+        uint64_t seed);  // seed of stream
+
+    // -------------------------------------------------------------------------
+    inline uint64_t next() {  // next 64-bit random number
+        uint64_t ret = rotl(s_[1] * 5, 7) * 9;
+        uint64_t t = s_[1] << 17;
+
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return ret;
+    }
+
+    // -------------------------------------------------------------------------
+    void uniform(   // n r.v. from Uniform(0, 1) (open interval)
+        int n,      // number of r.v.
+        float *u);  // r.v. (return)
+
+   protected:
+    uint64_t s_[4];  // state
+
+    // -------------------------------------------------------------------------
+    static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// -----------------------------------------------------------------------------
+inline uint64_t rand_seed()  // seed of a new stream drawn from rand()
+{
+    return ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+}
+
+// -----------------------------------------------------------------------------
+//  batched versions of the functions above, which draw n r.v. from a stream
+// -----------------------------------------------------------------------------
+void gaussian(     // n r.v. from Gaussian(mean, sigma)
+    Xoshiro &rng,  // random stream
+    int n,         // number of r.v.
+    float mu,      // mean (location)
+    float sigma,   // stanard deviation (scale > 0)
+    float *x);     // r.v. (return)
+
+// -----------------------------------------------------------------------------
+void cauchy(       // n r.v. from Cauchy(gamma, delta)
+    Xoshiro &rng,  // random stream
+    int n,         // number of r.v.
+    float gamma,   // scale factor (gamma > 0)
+    float delta,   // location
+    float *x);     // r.v. (return)
+
+// -----------------------------------------------------------------------------
+void levy(         // n r.v. from Levy(gamma, delta)
+    Xoshiro &rng,  // random stream
+    int n,         // number of r.v.
+    float gamma,   // scale factor (gamma > 0)
+    float delta,   // location
+    float *x);     // r.v. (return)
+
+// -----------------------------------------------------------------------------
+void p_stable(     // n r.v. from p-stable distr.
+    Xoshiro &rng,  // random stream
+    int n,         // number of r.v.
+    float p,       // p value, where p in (0,2]
+    float zeta,    // symmetric factor (zeta in [-1, 1])
+    float gamma,   // scale factor (gamma > 0)
+    float delta,   // location
+    float *x);     // r.v. (return)
+
 // -----------------------------------------------------------------------------
 //  functions used for calculating probability distribution function (pdf) and
 //  cumulative distribution function (cdf)
@@ -132,6 +212,13 @@ void new_stable_prob(  // calc new stable probability
     float &p1,         // p1 = p(w / (2 *r)), returned
     float &p2);        // p2 = p(w / (2 * c * r)), returned
 
+// -----------------------------------------------------------------------------
+float new_stable_prob(   // calc new stable probability (deterministic)
+    float p,             // the p value, where p in (0, 2]
+    float zeta,          // symmetric factor (zeta in [-1, 1])
+    float x,             // x = w / (2 * r)
+    int num = 20000);    // number of steps of quadrature
+
 // -----------------------------------------------------------------------------
 //  probability vs. w for a fixed ratio c
 // -----------------------------------------------------------------------------
@@ -0,0 +1,118 @@
+#include "run_file.h"
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+RunFile::RunFile(       // constructor
+    const char *fname)  // file name
+{
+    strcpy(fname_, fname);
+    fp_ = fopen(fname_, "w+b");
+    if (!fp_) {
+        printf("Could not create %s\n", fname_);
+        exit(1);
+    }
+    run_start_.push_back(0);
+
+    buf_size_ = 0;
+    buf_ = NULL;
+}
+
+// -----------------------------------------------------------------------------
+RunFile::~RunFile()  // destructor (remove file from disk)
+{
+    if (buf_ != NULL) {
+        delete[] buf_;
+        buf_ = NULL;
+    }
+    if (fp_ != NULL) {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+    remove(fname_);
+}
+
+// -----------------------------------------------------------------------------
+int RunFile::add_run(   // append a sorted run to the end of file
+    int n,              // number of pairs
+    const Result *run)  // sorted run (ascending)
+{
+    fseek(fp_, 0, SEEK_END);
+    if (fwrite(run, sizeof(Result), n, fp_) != (size_t)n) {
+        printf("Could not write %s\n", fname_);
+        return 1;
+    }
+    run_start_.push_back(run_start_.back() + n);
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+int RunFile::init_merge(  // init the k-way merge of all runs
+    uint64_t mem)         // memory of merge buffers (bytes)
+{
+    int num_runs = get_num_runs();
+    assert(num_runs > 0);
+
+    // split the memory into one buffer for each run (at least 1024 pairs)
+    buf_size_ = (int)std::min<uint64_t>(mem / ((uint64_t)num_runs * sizeof(Result)), MAXINT);
+    buf_size_ = std::max(buf_size_, 1024);
+    buf_ = new Result[(uint64_t)num_runs * buf_size_];
+
+    buf_pos_.assign(num_runs, 0);
+    buf_num_.assign(num_runs, 0);
+    file_pos_.assign(run_start_.begin(), run_start_.end() - 1);
+
+    // fill the buffers and build the min-heap of runs
+    heap_.clear();
+    for (int i = 0; i < num_runs; ++i) {
+        if (fill_buffer(i)) return 1;
+        if (buf_num_[i] > 0) heap_.push_back(i);
+    }
+    auto comp = [this](int r1, int r2) { return greater(r1, r2); };
+    std::make_heap(heap_.begin(), heap_.end(), comp);
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+int RunFile::fill_buffer(  // fill the merge buffer of a run from disk
+    int run)               // run id
+{
+    uint64_t num = std::min<uint64_t>(buf_size_, run_start_[run + 1] - file_pos_[run]);
+    buf_pos_[run] = 0;
+    buf_num_[run] = (int)num;
+    if (num == 0) return 0;
+
+    fseek(fp_, file_pos_[run] * sizeof(Result), SEEK_SET);
+    if (fread(&buf_[(uint64_t)run * buf_size_], sizeof(Result), num, fp_) != num) {
+        printf("Could not read %s\n", fname_);
+        return 1;
+    }
+    file_pos_[run] += num;
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+bool RunFile::next(  // get the next smallest pair
+    Result &r)       // pair (return)
+{
+    if (heap_.empty()) return false;
+
+    auto comp = [this](int r1, int r2) { return greater(r1, r2); };
+    std::pop_heap(heap_.begin(), heap_.end(), comp);
+    int run = heap_.back();
+    r = head(run);
+
+    // move to the next pair of this run
+    if (++buf_pos_[run] >= buf_num_[run]) {
+        if (fill_buffer(run)) exit(1);
+    }
+    if (buf_num_[run] > 0) {
+        std::push_heap(heap_.begin(), heap_.end(), comp);
+    } else {
+        heap_.pop_back();
+    }
+    return true;
+}
+
+}  // end namespace nns
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "def.h"
+#include "pri_queue.h"
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+//  RunFile: sorted runs of (key, id) pairs of one hash table stored on disk,
+//  used by the out-of-core indexing of QALSH. the runs are appended one by one
+//  and then merged by a k-way merge, which returns the pairs in the same order
+//  as sorting all of them with ResultComp.
+// -----------------------------------------------------------------------------
+class RunFile {
+   public:
+    RunFile(                 // constructor
+        const char *fname);  // file name
+
+    // -------------------------------------------------------------------------
+    ~RunFile();  // destructor (remove file from disk)
+
+    // -------------------------------------------------------------------------
+    int add_run(             // append a sorted run to the end of file
+        int n,               // number of pairs
+        const Result *run);  // sorted run (ascending)
+
+    // -------------------------------------------------------------------------
+    int init_merge(     // init the k-way merge of all runs
+        uint64_t mem);  // memory of merge buffers (bytes)
+
+    // -------------------------------------------------------------------------
+    bool next(       // get the next smallest pair
+        Result &r);  // pair (return)
+
+    // -------------------------------------------------------------------------
+    inline int get_num_runs() { return (int)run_start_.size() - 1; }
+
+    // -------------------------------------------------------------------------
+    inline uint64_t get_num_pairs() { return run_start_.back(); }
+
+   protected:
+    char fname_[300];                  // file name
+    FILE *fp_;                         // file pointer
+    std::vector<uint64_t> run_start_;  // start position of each run (and end)
+
+    int buf_size_;                    // max number of pairs in each buffer
+    Result *buf_;                     // merge buffers of all runs
+    std::vector<int> buf_pos_;        // current position in buffer of each run
+    std::vector<int> buf_num_;        // number of pairs in buffer of each run
+    std::vector<uint64_t> file_pos_;  // next position in file of each run
+    std::vector<int> heap_;           // min-heap of runs by their current pairs
+
+    // -------------------------------------------------------------------------
+    int fill_buffer(  // fill the merge buffer of a run from disk
+        int run);     // run id
+
+    // -------------------------------------------------------------------------
+    inline const Result &head(int run) {  // current pair of a run
+        return buf_[(uint64_t)run * buf_size_ + buf_pos_[run]];
+    }
+
+    // -------------------------------------------------------------------------
+    inline bool greater(int r1, int r2) {  // order of runs in min-heap
+        const Result &a = head(r1);
+        const Result &b = head(r2);
+        if (a.key_ != b.key_) return a.key_ > b.key_;
+        return a.id_ > b.id_;
+    }
+};
+
+}  // end namespace nns
@@ -0,0 +1,108 @@
+#include "scalar_quantizer.h"
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+ScalarQuantizer::ScalarQuantizer(  // constructor
+    int n,                         // number of data points
+    int d,                         // data dimension
+    int bits)                      // number of bits per coordinate (4 or 8)
+    : n_pts_(n), dim_(d), bits_(bits) {
+    assert(bits_ == 4 || bits_ == 8);
+    code_size_ = (dim_ * bits_ + 7) / 8;
+
+    min_ = new float[dim_];
+    max_ = new float[dim_];
+    scale_ = new float[dim_];
+    codes_ = new uint8_t[(uint64_t)n_pts_ * code_size_];
+    for (int j = 0; j < dim_; ++j) {
+        min_[j] = MAXREAL;
+        max_[j] = MINREAL;
+        scale_[j] = 0.0f;
+    }
+}
+
+// -----------------------------------------------------------------------------
+ScalarQuantizer::ScalarQuantizer(  // constructor (read from disk)
+    const char *fname)             // file name
+{
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        printf("Could not open %s\n", fname);
+        exit(1);
+    }
+    fread(&n_pts_, sizeof(int), 1, fp);
+    fread(&dim_, sizeof(int), 1, fp);
+    fread(&bits_, sizeof(int), 1, fp);
+    code_size_ = (dim_ * bits_ + 7) / 8;
+
+    min_ = new float[dim_];
+    max_ = new float[dim_];
+    scale_ = new float[dim_];
+    codes_ = new uint8_t[(uint64_t)n_pts_ * code_size_];
+    fread(min_, sizeof(float), dim_, fp);
+    fread(max_, sizeof(float), dim_, fp);
+    fread(scale_, sizeof(float), dim_, fp);
+
+    uint64_t size = (uint64_t)n_pts_ * code_size_;
+    if (fread(codes_, sizeof(uint8_t), size, fp) != size) {
+        printf("Could not read %d codes from %s\n", n_pts_, fname);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+// -----------------------------------------------------------------------------
+ScalarQuantizer::~ScalarQuantizer()  // destructor
+{
+    delete[] min_;
+    delete[] max_;
+    delete[] scale_;
+    delete[] codes_;
+}
+
+// -----------------------------------------------------------------------------
+void ScalarQuantizer::init_scale()  // init quantization steps from the ranges
+{
+    int levels = (1 << bits_) - 1;
+    for (int j = 0; j < dim_; ++j) {
+        if (min_[j] > max_[j]) min_[j] = max_[j] = 0.0f;  // no data point
+        scale_[j] = (max_[j] - min_[j]) / levels;
+    }
+}
+
+// -----------------------------------------------------------------------------
+float ScalarQuantizer::get_error(  // get max l_p distance from a point to its decoding
+    float p)                       // l_p distance, p \in [1,2] (MAXREAL for p < 1)
+{
+    // the triangle inequality does not hold for p < 1
+    if (p < 1.0f) return MAXREAL;
+
+    double sum = 0.0;
+    for (int j = 0; j < dim_; ++j) sum += pow(scale_[j] / 2.0, (double)p);
+
+    // with a small margin for the rounding of float
+    return (float)(pow(sum, 1.0 / p) * (1.0 + 1e-4));
+}
+
+// -----------------------------------------------------------------------------
+int ScalarQuantizer::write(  // write codes to disk
+    const char *fname)       // file name
+{
+    FILE *fp = fopen(fname, "wb");
+    if (!fp) {
+        printf("Could not create %s\n", fname);
+        return 1;
+    }
+    fwrite(&n_pts_, sizeof(int), 1, fp);
+    fwrite(&dim_, sizeof(int), 1, fp);
+    fwrite(&bits_, sizeof(int), 1, fp);
+    fwrite(min_, sizeof(float), dim_, fp);
+    fwrite(max_, sizeof(float), dim_, fp);
+    fwrite(scale_, sizeof(float), dim_, fp);
+    fwrite(codes_, sizeof(uint8_t), (uint64_t)n_pts_ * code_size_, fp);
+    fclose(fp);
+    return 0;
+}
+
+}  // end namespace nns
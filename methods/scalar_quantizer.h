@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "def.h"
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+//  ScalarQuantizer: an in-memory compressed copy of the data points. each
+//  coordinate is quantized uniformly within the range [min, max] of its
+//  dimension into 8 bits (SQ8, one byte) or 4 bits (SQ4, two in a byte).
+//  the ranges are taken over all data points, so each decoded coordinate is
+//  within half a step of the original one.
+//
+//  the codes are built in two passes: update_range() over all points (or
+//  chunks), then init_scale() and encode() over all points (or chunks).
+// -----------------------------------------------------------------------------
+class ScalarQuantizer {
+   public:
+    int n_pts_;       // number of data points
+    int dim_;         // data dimension
+    int bits_;        // number of bits per coordinate (4 or 8)
+    int code_size_;   // number of bytes per point
+    float *min_;      // min of each dimension
+    float *max_;      // max of each dimension
+    float *scale_;    // quantization step of each dimension
+    uint8_t *codes_;  // codes of data points (n_pts_ * code_size_)
+
+    // -------------------------------------------------------------------------
+    ScalarQuantizer(  // constructor
+        int n,        // number of data points
+        int d,        // data dimension
+        int bits);    // number of bits per coordinate (4 or 8)
+
+    // -------------------------------------------------------------------------
+    ScalarQuantizer(         // constructor (read from disk)
+        const char *fname);  // file name
+
+    // -------------------------------------------------------------------------
+    ~ScalarQuantizer();  // destructor
+
+    // -------------------------------------------------------------------------
+    template <class DType>
+    void update_range(      // update the range of each dimension
+        int n,              // number of data points
+        const DType *data)  // data points
+    {
+        for (int i = 0; i < n; ++i) {
+            const DType *x = &data[(uint64_t)i * dim_];
+            for (int j = 0; j < dim_; ++j) {
+                float v = (float)x[j];
+                if (v < min_[j]) min_[j] = v;
+                if (v > max_[j]) max_[j] = v;
+            }
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    void init_scale();  // init quantization steps from the ranges
+
+    // -------------------------------------------------------------------------
+    template <class DType>
+    void encode(            // encode data points
+        int n,              // number of data points
+        int start,          // id of the first data point
+        const DType *data)  // data points
+    {
+        int levels = (1 << bits_) - 1;
+        for (int i = 0; i < n; ++i) {
+            const DType *x = &data[(uint64_t)i * dim_];
+            uint8_t *code = &codes_[(uint64_t)(start + i) * code_size_];
+            memset(code, 0, code_size_);
+
+            for (int j = 0; j < dim_; ++j) {
+                int c = 0;
+                if (scale_[j] > 0.0f) {
+                    c = (int)floor(((float)x[j] - min_[j]) / scale_[j] + 0.5f);
+                    c = std::max(0, std::min(c, levels));
+                }
+                if (bits_ == 8)
+                    code[j] = (uint8_t)c;
+                else
+                    code[j >> 1] |= (uint8_t)(c << ((j & 1) << 2));
+            }
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    inline void decode(  // decode a data point
+        int id,          // data point id
+        float *x)        // decoded data point (return)
+    {
+        const uint8_t *code = &codes_[(uint64_t)id * code_size_];
+        if (bits_ == 8) {
+            for (int j = 0; j < dim_; ++j) x[j] = min_[j] + code[j] * scale_[j];
+        } else {
+            for (int j = 0; j < dim_; ++j) {
+                int c = (code[j >> 1] >> ((j & 1) << 2)) & 0x0F;
+                x[j] = min_[j] + c * scale_[j];
+            }
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    float get_error(  // get max l_p distance from a point to its decoding
+        float p);     // l_p distance, p \in [1,2] (MAXREAL for p < 1)
+
+    // -------------------------------------------------------------------------
+    int write(               // write codes to disk
+        const char *fname);  // file name
+
+    // -------------------------------------------------------------------------
+    uint64_t get_memory_usage() {  // get memory usage
+        return sizeof(*this) + sizeof(float) * 3 * dim_ + (uint64_t)n_pts_ * code_size_;
+    }
+};
+
+}  // end namespace nns
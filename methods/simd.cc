@@ -0,0 +1,1265 @@
+#include "simd.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "def.h"
+#include "util.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define NNS_SIMD_X86
+#endif
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+//  scalar kernel (for other cpus)
+// -----------------------------------------------------------------------------
+template <class DType>
+static void gemv_scalar(  // calc y = A x (scalar)
+    int m,                // number of rows of A
+    int d,                // dimensionality
+    const float *a,       // matrix A (m * d)
+    const DType *x,       // vector x (d)
+    float *y)             // vector y (m) (return)
+{
+    for (int i = 0; i < m; ++i) {
+        const float *row = &a[(uint64_t)i * d];
+        float r = 0.0f;
+        for (int k = 0; k < d; ++k) r += row[k] * (float)x[k];
+        y[i] = r;
+    }
+}
+
+#ifdef NNS_SIMD_X86
+// -----------------------------------------------------------------------------
+//  SSE2 kernel (baseline of x86-64): 4 lanes
+// -----------------------------------------------------------------------------
+namespace sse2 {
+
+static inline __m128 load(const float *x) { return _mm_loadu_ps(x); }
+
+static inline __m128 load(const int *x) { return _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)x)); }
+
+static inline __m128 load(const uint16_t *x) {
+    __m128i v = _mm_loadl_epi64((const __m128i *)x);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+
+static inline __m128 load(const uint8_t *x) {
+    int t = 0;
+    memcpy(&t, x, sizeof(int));
+    __m128i z = _mm_setzero_si128();
+    __m128i v = _mm_cvtsi32_si128(t);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(v, z), z));
+}
+
+static inline float hsum(__m128 v) {
+    __m128 t = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(t, _mm_shuffle_ps(t, t, 1)));
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static void gemv(    // calc y = A x (sse2)
+    int m,           // number of rows of A
+    int d,           // dimensionality
+    const float *a,  // matrix A (m * d)
+    const DType *x,  // vector x (d)
+    float *y)        // vector y (m) (return)
+{
+    int dv = d & ~3;
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        const float *a0 = &a[(uint64_t)i * d];
+        const float *a1 = a0 + d;
+        const float *a2 = a1 + d;
+        const float *a3 = a2 + d;
+        __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+        __m128 s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps();
+        for (int k = 0; k < dv; k += 4) {
+            __m128 v = load(&x[k]);
+            s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(&a0[k]), v));
+            s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(&a1[k]), v));
+            s2 = _mm_add_ps(s2, _mm_mul_ps(_mm_loadu_ps(&a2[k]), v));
+            s3 = _mm_add_ps(s3, _mm_mul_ps(_mm_loadu_ps(&a3[k]), v));
+        }
+        float r0 = hsum(s0), r1 = hsum(s1), r2 = hsum(s2), r3 = hsum(s3);
+        for (int k = dv; k < d; ++k) {
+            float v = (float)x[k];
+            r0 += a0[k] * v;
+            r1 += a1[k] * v;
+            r2 += a2[k] * v;
+            r3 += a3[k] * v;
+        }
+        y[i] = r0;
+        y[i + 1] = r1;
+        y[i + 2] = r2;
+        y[i + 3] = r3;
+    }
+    for (; i < m; ++i) {
+        const float *a0 = &a[(uint64_t)i * d];
+        __m128 s0 = _mm_setzero_ps();
+        for (int k = 0; k < dv; k += 4) {
+            s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(&a0[k]), load(&x[k])));
+        }
+        float r0 = hsum(s0);
+        for (int k = dv; k < d; ++k) r0 += a0[k] * (float)x[k];
+        y[i] = r0;
+    }
+}
+
+}  // end namespace sse2
+
+// -----------------------------------------------------------------------------
+//  AVX2 kernel: 8 lanes with fma
+// -----------------------------------------------------------------------------
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace avx2 {
+
+static inline __m256 load(const float *x) { return _mm256_loadu_ps(x); }
+
+static inline __m256 load(const int *x) { return _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)x)); }
+
+static inline __m256 load(const uint16_t *x) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)x)));
+}
+
+static inline __m256 load(const uint8_t *x) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)x)));
+}
+
+static inline float hsum(__m256 v) {
+    __m128 t = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+    return _mm_cvtss_f32(_mm_add_ss(t, _mm_shuffle_ps(t, t, 1)));
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static void gemv(    // calc y = A x (avx2)
+    int m,           // number of rows of A
+    int d,           // dimensionality
+    const float *a,  // matrix A (m * d)
+    const DType *x,  // vector x (d)
+    float *y)        // vector y (m) (return)
+{
+    int dv = d & ~7;
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        const float *a0 = &a[(uint64_t)i * d];
+        const float *a1 = a0 + d;
+        const float *a2 = a1 + d;
+        const float *a3 = a2 + d;
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+        __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+        for (int k = 0; k < dv; k += 8) {
+            __m256 v = load(&x[k]);
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a0[k]), v, s0);
+            s1 = _mm256_fmadd_ps(_mm256_loadu_ps(&a1[k]), v, s1);
+            s2 = _mm256_fmadd_ps(_mm256_loadu_ps(&a2[k]), v, s2);
+            s3 = _mm256_fmadd_ps(_mm256_loadu_ps(&a3[k]), v, s3);
+        }
+        float r0 = hsum(s0), r1 = hsum(s1), r2 = hsum(s2), r3 = hsum(s3);
+        for (int k = dv; k < d; ++k) {
+            float v = (float)x[k];
+            r0 += a0[k] * v;
+            r1 += a1[k] * v;
+            r2 += a2[k] * v;
+            r3 += a3[k] * v;
+        }
+        y[i] = r0;
+        y[i + 1] = r1;
+        y[i + 2] = r2;
+        y[i + 3] = r3;
+    }
+    for (; i < m; ++i) {
+        const float *a0 = &a[(uint64_t)i * d];
+        __m256 s0 = _mm256_setzero_ps();
+        for (int k = 0; k < dv; k += 8) {
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a0[k]), load(&x[k]), s0);
+        }
+        float r0 = hsum(s0);
+        for (int k = dv; k < d; ++k) r0 += a0[k] * (float)x[k];
+        y[i] = r0;
+    }
+}
+
+// -----------------------------------------------------------------------------
+static inline int hsum_epi32(__m256i v) {
+    __m128i t = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    t = _mm_add_epi32(t, _mm_shuffle_epi32(t, 0x4e));
+    t = _mm_add_epi32(t, _mm_shuffle_epi32(t, 0xb1));
+    return _mm_cvtsi128_si32(t);
+}
+
+static inline int64_t hsum_epi64(__m256i v) {
+    __m128i t = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_cvtsi128_si64(t) + _mm_extract_epi64(t, 1);
+}
+
+static inline __m256 absf(__m256 v) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v); }
+
+// -----------------------------------------------------------------------------
+//  pairwise sums (int32) of (x - y)^2 and of x * y of 32 uint8 lanes
+// -----------------------------------------------------------------------------
+static inline __m256i sqr_diff(__m256i x, __m256i y) {
+    const __m256i z = _mm256_setzero_si256();
+    __m256i t = _mm256_or_si256(_mm256_subs_epu8(x, y), _mm256_subs_epu8(y, x));
+    __m256i lo = _mm256_unpacklo_epi8(t, z);
+    __m256i hi = _mm256_unpackhi_epi8(t, z);
+    return _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi));
+}
+
+static inline __m256i dot_u8(__m256i x, __m256i y) {
+    const __m256i z = _mm256_setzero_si256();
+    return _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(x, z), _mm256_unpacklo_epi8(y, z)),
+                            _mm256_madd_epi16(_mm256_unpackhi_epi8(x, z), _mm256_unpackhi_epi8(y, z)));
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float l2_sqr(      // calc l2 square distance (avx2)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const DType *a,       // 1st point
+    const DType *b)       // 2nd point
+{
+    int dv = dim & ~7;
+    int k = 0;
+    __m256 s = _mm256_setzero_ps();
+    while (k < dv) {
+        for (int end = std::min(k + DIST_CHECK, dv); k < end; k += 8) {
+            __m256 t = _mm256_sub_ps(load(&a[k]), load(&b[k]));
+            s = _mm256_fmadd_ps(t, t, s);
+        }
+        if (k < dv && hsum(s) > threshold) return hsum(s);
+    }
+    float r = hsum(s);
+    for (; k < dim; ++k) r += SQR((float)a[k] - (float)b[k]);
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+//  uint8: |a - b| by saturated subtraction, widened to 16 bits and squared and
+//  summed in pairs by vpmaddwd, i.e., exact integer accumulation
+// -----------------------------------------------------------------------------
+static float l2_sqr(      // calc l2 square distance (avx2, uint8)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const uint8_t *a,     // 1st point
+    const uint8_t *b)     // 2nd point
+{
+    int dv = dim & ~31;
+    int k = 0;
+    __m256i s = _mm256_setzero_si256();
+    while (k < dv) {
+        for (int end = std::min(k + DIST_CHECK, dv); k < end; k += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)&a[k]);
+            __m256i y = _mm256_loadu_si256((const __m256i *)&b[k]);
+            s = _mm256_add_epi32(s, sqr_diff(x, y));
+        }
+        if (k < dv && (float)hsum_epi32(s) > threshold) return (float)hsum_epi32(s);
+    }
+    if (k + 16 <= dim) {
+        __m128i x = _mm_loadu_si128((const __m128i *)&a[k]);
+        __m128i y = _mm_loadu_si128((const __m128i *)&b[k]);
+        __m128i t = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+        __m256i w = _mm256_cvtepu8_epi16(t);
+        s = _mm256_add_epi32(s, _mm256_madd_epi16(w, w));
+        k += 16;
+    }
+    int r = hsum_epi32(s);
+    for (; k < dim; ++k) r += SQR((int)a[k] - (int)b[k]);
+    return (float)r;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float l1_dist(     // calc Manhattan distance (avx2)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const DType *a,       // 1st point
+    const DType *b)       // 2nd point
+{
+    int dv = dim & ~7;
+    int k = 0;
+    __m256 s = _mm256_setzero_ps();
+    while (k < dv) {
+        for (int end = std::min(k + DIST_CHECK, dv); k < end; k += 8) {
+            s = _mm256_add_ps(s, absf(_mm256_sub_ps(load(&a[k]), load(&b[k]))));
+        }
+        if (k < dv && hsum(s) > threshold) return hsum(s);
+    }
+    float r = hsum(s);
+    for (; k < dim; ++k) r += fabs((float)a[k] - (float)b[k]);
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+//  uint8: |a - b| by saturated subtraction, summed by vpsadbw
+// -----------------------------------------------------------------------------
+static float l1_dist(     // calc Manhattan distance (avx2, uint8)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const uint8_t *a,     // 1st point
+    const uint8_t *b)     // 2nd point
+{
+    const __m256i z = _mm256_setzero_si256();
+    int dv = dim & ~31;
+    int k = 0;
+    __m256i s = _mm256_setzero_si256();
+    while (k < dv) {
+        for (int end = std::min(k + DIST_CHECK, dv); k < end; k += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)&a[k]);
+            __m256i y = _mm256_loadu_si256((const __m256i *)&b[k]);
+            __m256i t = _mm256_or_si256(_mm256_subs_epu8(x, y), _mm256_subs_epu8(y, x));
+            s = _mm256_add_epi64(s, _mm256_sad_epu8(t, z));
+        }
+        if (k < dv && (float)hsum_epi64(s) > threshold) return (float)hsum_epi64(s);
+    }
+    int64_t r = hsum_epi64(s);
+    if (k + 16 <= dim) {
+        __m128i x = _mm_loadu_si128((const __m128i *)&a[k]);
+        __m128i y = _mm_loadu_si128((const __m128i *)&b[k]);
+        __m128i t = _mm_sad_epu8(_mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x)), _mm_setzero_si128());
+        r += _mm_cvtsi128_si64(t) + _mm_extract_epi64(t, 1);
+        k += 16;
+    }
+    for (; k < dim; ++k) r += abs((int)a[k] - (int)b[k]);
+    return (float)r;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float l0_sqrt(     // calc l_{0.5} sqrt distance (avx2)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const DType *a,       // 1st point
+    const DType *b)       // 2nd point
+{
+    int dv = dim & ~7;
+    int k = 0;
+    __m256 s = _mm256_setzero_ps();
+    while (k < dv) {
+        for (int end = std::min(k + DIST_CHECK, dv); k < end; k += 8) {
+            s = _mm256_add_ps(s, _mm256_sqrt_ps(absf(_mm256_sub_ps(load(&a[k]), load(&b[k])))));
+        }
+        if (k < dv && hsum(s) > threshold) return hsum(s);
+    }
+    float r = hsum(s);
+    for (; k < dim; ++k) r += sqrt(fabs((float)a[k] - (float)b[k]));
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+static inline __m256i load_epi32(const uint8_t *x) {
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)x));
+}
+
+static inline __m256i load_epi32(const uint16_t *x) {
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)x));
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float lp_pow(     // calc l_p pow_p distance by table (avx2)
+    int dim,             // dimension
+    float threshold,     // threshold
+    const float *table,  // table of |a - b|^p
+    const DType *a,      // 1st point
+    const DType *b)      // 2nd point
+{
+    int dv = dim & ~7;
+    int k = 0;
+    __m256 s = _mm256_setzero_ps();
+    while (k < dv) {
+        for (int end = std::min(k + DIST_CHECK, dv); k < end; k += 8) {
+            __m256i t = _mm256_abs_epi32(_mm256_sub_epi32(load_epi32(&a[k]), load_epi32(&b[k])));
+            s = _mm256_add_ps(s, _mm256_i32gather_ps(table, t, 4));
+        }
+        if (k < dv && hsum(s) > threshold) return hsum(s);
+    }
+    float r = hsum(s);
+    for (; k < dim; ++k) r += table[abs((int)a[k] - (int)b[k])];
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+//  one-to-many kernels: the distances (or inner products) from a query to n
+//  consecutive points, four points at a time, so that each chunk of the query
+//  is loaded (and converted) once for four points
+// -----------------------------------------------------------------------------
+template <class DType>
+static void l2_sqr_batch(  // calc l2 square distances to n points (avx2)
+    int n,                 // number of points
+    int d,                 // dimensionality
+    const DType *q,        // query point
+    const DType *x,        // points (n * d)
+    float *dist)           // l2 square distances (return)
+{
+    int dv = d & ~7;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const DType *x0 = &x[(uint64_t)i * d];
+        const DType *x1 = x0 + d;
+        const DType *x2 = x1 + d;
+        const DType *x3 = x2 + d;
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+        __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+        for (int k = 0; k < dv; k += 8) {
+            __m256 v = load(&q[k]);
+            __m256 t0 = _mm256_sub_ps(load(&x0[k]), v);
+            __m256 t1 = _mm256_sub_ps(load(&x1[k]), v);
+            __m256 t2 = _mm256_sub_ps(load(&x2[k]), v);
+            __m256 t3 = _mm256_sub_ps(load(&x3[k]), v);
+            s0 = _mm256_fmadd_ps(t0, t0, s0);
+            s1 = _mm256_fmadd_ps(t1, t1, s1);
+            s2 = _mm256_fmadd_ps(t2, t2, s2);
+            s3 = _mm256_fmadd_ps(t3, t3, s3);
+        }
+        float r0 = hsum(s0), r1 = hsum(s1), r2 = hsum(s2), r3 = hsum(s3);
+        for (int k = dv; k < d; ++k) {
+            float v = (float)q[k];
+            r0 += SQR((float)x0[k] - v);
+            r1 += SQR((float)x1[k] - v);
+            r2 += SQR((float)x2[k] - v);
+            r3 += SQR((float)x3[k] - v);
+        }
+        dist[i] = r0;
+        dist[i + 1] = r1;
+        dist[i + 2] = r2;
+        dist[i + 3] = r3;
+    }
+    for (; i < n; ++i) dist[i] = l2_sqr(d, MAXREAL, &x[(uint64_t)i * d], q);
+}
+
+// -----------------------------------------------------------------------------
+static void l2_sqr_batch(  // calc l2 square distances to n points (avx2, uint8)
+    int n,                 // number of points
+    int d,                 // dimensionality
+    const uint8_t *q,      // query point
+    const uint8_t *x,      // points (n * d)
+    float *dist)           // l2 square distances (return)
+{
+    int dv = d & ~31;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t *x0 = &x[(uint64_t)i * d];
+        const uint8_t *x1 = x0 + d;
+        const uint8_t *x2 = x1 + d;
+        const uint8_t *x3 = x2 + d;
+        __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+        __m256i s2 = _mm256_setzero_si256(), s3 = _mm256_setzero_si256();
+        for (int k = 0; k < dv; k += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&q[k]);
+            s0 = _mm256_add_epi32(s0, sqr_diff(_mm256_loadu_si256((const __m256i *)&x0[k]), v));
+            s1 = _mm256_add_epi32(s1, sqr_diff(_mm256_loadu_si256((const __m256i *)&x1[k]), v));
+            s2 = _mm256_add_epi32(s2, sqr_diff(_mm256_loadu_si256((const __m256i *)&x2[k]), v));
+            s3 = _mm256_add_epi32(s3, sqr_diff(_mm256_loadu_si256((const __m256i *)&x3[k]), v));
+        }
+        int r0 = hsum_epi32(s0), r1 = hsum_epi32(s1), r2 = hsum_epi32(s2), r3 = hsum_epi32(s3);
+        for (int k = dv; k < d; ++k) {
+            int v = (int)q[k];
+            r0 += SQR((int)x0[k] - v);
+            r1 += SQR((int)x1[k] - v);
+            r2 += SQR((int)x2[k] - v);
+            r3 += SQR((int)x3[k] - v);
+        }
+        dist[i] = (float)r0;
+        dist[i + 1] = (float)r1;
+        dist[i + 2] = (float)r2;
+        dist[i + 3] = (float)r3;
+    }
+    for (; i < n; ++i) dist[i] = l2_sqr(d, MAXREAL, &x[(uint64_t)i * d], q);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static void dot_batch(  // calc inner products with n points (avx2)
+    int n,              // number of points
+    int d,              // dimensionality
+    const DType *q,     // query point
+    const DType *x,     // points (n * d)
+    float *dot)         // inner products (return)
+{
+    int dv = d & ~7;
+    for (int i = 0; i < n; ++i) {
+        const DType *x0 = &x[(uint64_t)i * d];
+        __m256 s0 = _mm256_setzero_ps();
+        for (int k = 0; k < dv; k += 8) s0 = _mm256_fmadd_ps(load(&x0[k]), load(&q[k]), s0);
+
+        float r0 = hsum(s0);
+        for (int k = dv; k < d; ++k) r0 += (float)x0[k] * (float)q[k];
+        dot[i] = r0;
+    }
+}
+
+// -----------------------------------------------------------------------------
+static void dot_batch(  // calc inner products with n points (avx2, uint8)
+    int n,              // number of points
+    int d,              // dimensionality
+    const uint8_t *q,   // query point
+    const uint8_t *x,   // points (n * d)
+    float *dot)         // inner products (return)
+{
+    int dv = d & ~31;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t *x0 = &x[(uint64_t)i * d];
+        const uint8_t *x1 = x0 + d;
+        const uint8_t *x2 = x1 + d;
+        const uint8_t *x3 = x2 + d;
+        __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+        __m256i s2 = _mm256_setzero_si256(), s3 = _mm256_setzero_si256();
+        for (int k = 0; k < dv; k += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&q[k]);
+            s0 = _mm256_add_epi32(s0, dot_u8(_mm256_loadu_si256((const __m256i *)&x0[k]), v));
+            s1 = _mm256_add_epi32(s1, dot_u8(_mm256_loadu_si256((const __m256i *)&x1[k]), v));
+            s2 = _mm256_add_epi32(s2, dot_u8(_mm256_loadu_si256((const __m256i *)&x2[k]), v));
+            s3 = _mm256_add_epi32(s3, dot_u8(_mm256_loadu_si256((const __m256i *)&x3[k]), v));
+        }
+        int r0 = hsum_epi32(s0), r1 = hsum_epi32(s1), r2 = hsum_epi32(s2), r3 = hsum_epi32(s3);
+        for (int k = dv; k < d; ++k) {
+            int v = (int)q[k];
+            r0 += (int)x0[k] * v;
+            r1 += (int)x1[k] * v;
+            r2 += (int)x2[k] * v;
+            r3 += (int)x3[k] * v;
+        }
+        dot[i] = (float)r0;
+        dot[i + 1] = (float)r1;
+        dot[i + 2] = (float)r2;
+        dot[i + 3] = (float)r3;
+    }
+    for (; i < n; ++i) {
+        const uint8_t *x0 = &x[(uint64_t)i * d];
+        int r0 = 0;
+        for (int k = 0; k < d; ++k) r0 += (int)x0[k] * (int)q[k];
+        dot[i] = (float)r0;
+    }
+}
+
+}  // end namespace avx2
+#pragma GCC pop_options
+
+// -----------------------------------------------------------------------------
+//  AVX-512 kernel: 16 lanes with fma (the distance kernels use masked loads
+//  of avx512bw/vl for the last chunk of dimensions)
+// -----------------------------------------------------------------------------
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512vl")
+namespace avx512 {
+
+static inline __m512 load(const float *x) { return _mm512_loadu_ps(x); }
+
+static inline __m512 load(const int *x) { return _mm512_cvtepi32_ps(_mm512_loadu_si512(x)); }
+
+static inline __m512 load(const uint16_t *x) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)x)));
+}
+
+static inline __m512 load(const uint8_t *x) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)x)));
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static void gemv(    // calc y = A x (avx-512)
+    int m,           // number of rows of A
+    int d,           // dimensionality
+    const float *a,  // matrix A (m * d)
+    const DType *x,  // vector x (d)
+    float *y)        // vector y (m) (return)
+{
+    int dv = d & ~15;
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        const float *a0 = &a[(uint64_t)i * d];
+        const float *a1 = a0 + d;
+        const float *a2 = a1 + d;
+        const float *a3 = a2 + d;
+        __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+        __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+        for (int k = 0; k < dv; k += 16) {
+            __m512 v = load(&x[k]);
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(&a0[k]), v, s0);
+            s1 = _mm512_fmadd_ps(_mm512_loadu_ps(&a1[k]), v, s1);
+            s2 = _mm512_fmadd_ps(_mm512_loadu_ps(&a2[k]), v, s2);
+            s3 = _mm512_fmadd_ps(_mm512_loadu_ps(&a3[k]), v, s3);
+        }
+        float r0 = _mm512_reduce_add_ps(s0), r1 = _mm512_reduce_add_ps(s1);
+        float r2 = _mm512_reduce_add_ps(s2), r3 = _mm512_reduce_add_ps(s3);
+        for (int k = dv; k < d; ++k) {
+            float v = (float)x[k];
+            r0 += a0[k] * v;
+            r1 += a1[k] * v;
+            r2 += a2[k] * v;
+            r3 += a3[k] * v;
+        }
+        y[i] = r0;
+        y[i + 1] = r1;
+        y[i + 2] = r2;
+        y[i + 3] = r3;
+    }
+    for (; i < m; ++i) {
+        const float *a0 = &a[(uint64_t)i * d];
+        __m512 s0 = _mm512_setzero_ps();
+        for (int k = 0; k < dv; k += 16) {
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(&a0[k]), load(&x[k]), s0);
+        }
+        float r0 = _mm512_reduce_add_ps(s0);
+        for (int k = dv; k < d; ++k) r0 += a0[k] * (float)x[k];
+        y[i] = r0;
+    }
+}
+
+// -----------------------------------------------------------------------------
+static inline __m512 load(const float *x, __mmask16 m) { return _mm512_maskz_loadu_ps(m, x); }
+
+static inline __m512 load(const int *x, __mmask16 m) { return _mm512_cvtepi32_ps(_mm512_maskz_loadu_epi32(m, x)); }
+
+static inline __m512 load(const uint16_t *x, __mmask16 m) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(m, x)));
+}
+
+static inline __m512 load(const uint8_t *x, __mmask16 m) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(m, x)));
+}
+
+static inline __mmask16 mask16(int n) { return n >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << n) - 1); }
+
+static inline __mmask64 mask64(int n) { return n >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << n) - 1); }
+
+static inline __m512 absf(__m512 v) { return _mm512_abs_ps(v); }
+
+// -----------------------------------------------------------------------------
+//  pairwise sums (int32) of (x - y)^2 and of x * y of 64 uint8 lanes
+// -----------------------------------------------------------------------------
+static inline __m512i sqr_diff(__m512i x, __m512i y) {
+    const __m512i z = _mm512_setzero_si512();
+    __m512i t = _mm512_or_si512(_mm512_subs_epu8(x, y), _mm512_subs_epu8(y, x));
+    __m512i lo = _mm512_unpacklo_epi8(t, z);
+    __m512i hi = _mm512_unpackhi_epi8(t, z);
+    return _mm512_add_epi32(_mm512_madd_epi16(lo, lo), _mm512_madd_epi16(hi, hi));
+}
+
+static inline __m512i dot_u8(__m512i x, __m512i y) {
+    const __m512i z = _mm512_setzero_si512();
+    return _mm512_add_epi32(_mm512_madd_epi16(_mm512_unpacklo_epi8(x, z), _mm512_unpacklo_epi8(y, z)),
+                            _mm512_madd_epi16(_mm512_unpackhi_epi8(x, z), _mm512_unpackhi_epi8(y, z)));
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float l2_sqr(      // calc l2 square distance (avx-512)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const DType *a,       // 1st point
+    const DType *b)       // 2nd point
+{
+    int k = 0;
+    __m512 s = _mm512_setzero_ps();
+    while (k < dim) {
+        for (int end = std::min(k + DIST_CHECK, dim); k < end; k += 16) {
+            __mmask16 m = mask16(end - k);
+            __m512 t = _mm512_sub_ps(load(&a[k], m), load(&b[k], m));
+            s = _mm512_fmadd_ps(t, t, s);
+        }
+        if (k < dim && _mm512_reduce_add_ps(s) > threshold) break;
+    }
+    return _mm512_reduce_add_ps(s);
+}
+
+// -----------------------------------------------------------------------------
+static float l2_sqr(      // calc l2 square distance (avx-512, uint8)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const uint8_t *a,     // 1st point
+    const uint8_t *b)     // 2nd point
+{
+    int k = 0;
+    __m512i s = _mm512_setzero_si512();
+    while (k < dim) {
+        for (int end = std::min(k + DIST_CHECK, dim); k < end; k += 64) {
+            __mmask64 m = mask64(end - k);
+            __m512i x = _mm512_maskz_loadu_epi8(m, &a[k]);
+            __m512i y = _mm512_maskz_loadu_epi8(m, &b[k]);
+            s = _mm512_add_epi32(s, sqr_diff(x, y));
+        }
+        if (k < dim && (float)_mm512_reduce_add_epi32(s) > threshold) break;
+    }
+    return (float)_mm512_reduce_add_epi32(s);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float l1_dist(     // calc Manhattan distance (avx-512)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const DType *a,       // 1st point
+    const DType *b)       // 2nd point
+{
+    int k = 0;
+    __m512 s = _mm512_setzero_ps();
+    while (k < dim) {
+        for (int end = std::min(k + DIST_CHECK, dim); k < end; k += 16) {
+            __mmask16 m = mask16(end - k);
+            s = _mm512_add_ps(s, absf(_mm512_sub_ps(load(&a[k], m), load(&b[k], m))));
+        }
+        if (k < dim && _mm512_reduce_add_ps(s) > threshold) break;
+    }
+    return _mm512_reduce_add_ps(s);
+}
+
+// -----------------------------------------------------------------------------
+static float l1_dist(     // calc Manhattan distance (avx-512, uint8)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const uint8_t *a,     // 1st point
+    const uint8_t *b)     // 2nd point
+{
+    const __m512i z = _mm512_setzero_si512();
+    int k = 0;
+    __m512i s = _mm512_setzero_si512();
+    while (k < dim) {
+        for (int end = std::min(k + DIST_CHECK, dim); k < end; k += 64) {
+            __mmask64 m = mask64(end - k);
+            __m512i x = _mm512_maskz_loadu_epi8(m, &a[k]);
+            __m512i y = _mm512_maskz_loadu_epi8(m, &b[k]);
+            __m512i t = _mm512_or_si512(_mm512_subs_epu8(x, y), _mm512_subs_epu8(y, x));
+            s = _mm512_add_epi64(s, _mm512_sad_epu8(t, z));
+        }
+        if (k < dim && (float)_mm512_reduce_add_epi64(s) > threshold) break;
+    }
+    return (float)_mm512_reduce_add_epi64(s);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float l0_sqrt(     // calc l_{0.5} sqrt distance (avx-512)
+    int dim,              // dimension
+    float threshold,      // threshold
+    const DType *a,       // 1st point
+    const DType *b)       // 2nd point
+{
+    int k = 0;
+    __m512 s = _mm512_setzero_ps();
+    while (k < dim) {
+        for (int end = std::min(k + DIST_CHECK, dim); k < end; k += 16) {
+            __mmask16 m = mask16(end - k);
+            s = _mm512_add_ps(s, _mm512_sqrt_ps(absf(_mm512_sub_ps(load(&a[k], m), load(&b[k], m)))));
+        }
+        if (k < dim && _mm512_reduce_add_ps(s) > threshold) break;
+    }
+    return _mm512_reduce_add_ps(s);
+}
+
+// -----------------------------------------------------------------------------
+static inline __m512i load_epi32(const uint8_t *x, __mmask16 m) {
+    return _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(m, x));
+}
+
+static inline __m512i load_epi32(const uint16_t *x, __mmask16 m) {
+    return _mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(m, x));
+}
+
+// -----------------------------------------------------------------------------
+//  masked lanes load zeros for both points, and table[0] = 0
+// -----------------------------------------------------------------------------
+template <class DType>
+static float lp_pow(     // calc l_p pow_p distance by table (avx-512)
+    int dim,             // dimension
+    float threshold,     // threshold
+    const float *table,  // table of |a - b|^p
+    const DType *a,      // 1st point
+    const DType *b)      // 2nd point
+{
+    int k = 0;
+    __m512 s = _mm512_setzero_ps();
+    while (k < dim) {
+        for (int end = std::min(k + DIST_CHECK, dim); k < end; k += 16) {
+            __mmask16 m = mask16(end - k);
+            __m512i t = _mm512_abs_epi32(_mm512_sub_epi32(load_epi32(&a[k], m), load_epi32(&b[k], m)));
+            s = _mm512_add_ps(s, _mm512_i32gather_ps(t, table, 4));
+        }
+        if (k < dim && _mm512_reduce_add_ps(s) > threshold) break;
+    }
+    return _mm512_reduce_add_ps(s);
+}
+
+// -----------------------------------------------------------------------------
+//  one-to-many kernels (see avx2), with masked loads for the last chunk
+// -----------------------------------------------------------------------------
+template <class DType>
+static void l2_sqr_batch(  // calc l2 square distances to n points (avx-512)
+    int n,                 // number of points
+    int d,                 // dimensionality
+    const DType *q,        // query point
+    const DType *x,        // points (n * d)
+    float *dist)           // l2 square distances (return)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const DType *x0 = &x[(uint64_t)i * d];
+        const DType *x1 = x0 + d;
+        const DType *x2 = x1 + d;
+        const DType *x3 = x2 + d;
+        __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+        __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+        for (int k = 0; k < d; k += 16) {
+            __mmask16 m = mask16(d - k);
+            __m512 v = load(&q[k], m);
+            __m512 t0 = _mm512_sub_ps(load(&x0[k], m), v);
+            __m512 t1 = _mm512_sub_ps(load(&x1[k], m), v);
+            __m512 t2 = _mm512_sub_ps(load(&x2[k], m), v);
+            __m512 t3 = _mm512_sub_ps(load(&x3[k], m), v);
+            s0 = _mm512_fmadd_ps(t0, t0, s0);
+            s1 = _mm512_fmadd_ps(t1, t1, s1);
+            s2 = _mm512_fmadd_ps(t2, t2, s2);
+            s3 = _mm512_fmadd_ps(t3, t3, s3);
+        }
+        dist[i] = _mm512_reduce_add_ps(s0);
+        dist[i + 1] = _mm512_reduce_add_ps(s1);
+        dist[i + 2] = _mm512_reduce_add_ps(s2);
+        dist[i + 3] = _mm512_reduce_add_ps(s3);
+    }
+    for (; i < n; ++i) dist[i] = l2_sqr(d, MAXREAL, &x[(uint64_t)i * d], q);
+}
+
+// -----------------------------------------------------------------------------
+static void l2_sqr_batch(  // calc l2 square distances to n points (avx-512, uint8)
+    int n,                 // number of points
+    int d,                 // dimensionality
+    const uint8_t *q,      // query point
+    const uint8_t *x,      // points (n * d)
+    float *dist)           // l2 square distances (return)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t *x0 = &x[(uint64_t)i * d];
+        const uint8_t *x1 = x0 + d;
+        const uint8_t *x2 = x1 + d;
+        const uint8_t *x3 = x2 + d;
+        __m512i s0 = _mm512_setzero_si512(), s1 = _mm512_setzero_si512();
+        __m512i s2 = _mm512_setzero_si512(), s3 = _mm512_setzero_si512();
+        for (int k = 0; k < d; k += 64) {
+            __mmask64 m = mask64(d - k);
+            __m512i v = _mm512_maskz_loadu_epi8(m, &q[k]);
+            s0 = _mm512_add_epi32(s0, sqr_diff(_mm512_maskz_loadu_epi8(m, &x0[k]), v));
+            s1 = _mm512_add_epi32(s1, sqr_diff(_mm512_maskz_loadu_epi8(m, &x1[k]), v));
+            s2 = _mm512_add_epi32(s2, sqr_diff(_mm512_maskz_loadu_epi8(m, &x2[k]), v));
+            s3 = _mm512_add_epi32(s3, sqr_diff(_mm512_maskz_loadu_epi8(m, &x3[k]), v));
+        }
+        dist[i] = (float)_mm512_reduce_add_epi32(s0);
+        dist[i + 1] = (float)_mm512_reduce_add_epi32(s1);
+        dist[i + 2] = (float)_mm512_reduce_add_epi32(s2);
+        dist[i + 3] = (float)_mm512_reduce_add_epi32(s3);
+    }
+    for (; i < n; ++i) dist[i] = l2_sqr(d, MAXREAL, &x[(uint64_t)i * d], q);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static void dot_batch(  // calc inner products with n points (avx-512)
+    int n,              // number of points
+    int d,              // dimensionality
+    const DType *q,     // query point
+    const DType *x,     // points (n * d)
+    float *dot)         // inner products (return)
+{
+    for (int i = 0; i < n; ++i) {
+        const DType *x0 = &x[(uint64_t)i * d];
+        __m512 s0 = _mm512_setzero_ps();
+        for (int k = 0; k < d; k += 16) {
+            __mmask16 m = mask16(d - k);
+            s0 = _mm512_fmadd_ps(load(&x0[k], m), load(&q[k], m), s0);
+        }
+        dot[i] = _mm512_reduce_add_ps(s0);
+    }
+}
+
+// -----------------------------------------------------------------------------
+static void dot_batch(  // calc inner products with n points (avx-512, uint8)
+    int n,              // number of points
+    int d,              // dimensionality
+    const uint8_t *q,   // query point
+    const uint8_t *x,   // points (n * d)
+    float *dot)         // inner products (return)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t *x0 = &x[(uint64_t)i * d];
+        const uint8_t *x1 = x0 + d;
+        const uint8_t *x2 = x1 + d;
+        const uint8_t *x3 = x2 + d;
+        __m512i s0 = _mm512_setzero_si512(), s1 = _mm512_setzero_si512();
+        __m512i s2 = _mm512_setzero_si512(), s3 = _mm512_setzero_si512();
+        for (int k = 0; k < d; k += 64) {
+            __mmask64 m = mask64(d - k);
+            __m512i v = _mm512_maskz_loadu_epi8(m, &q[k]);
+            s0 = _mm512_add_epi32(s0, dot_u8(_mm512_maskz_loadu_epi8(m, &x0[k]), v));
+            s1 = _mm512_add_epi32(s1, dot_u8(_mm512_maskz_loadu_epi8(m, &x1[k]), v));
+            s2 = _mm512_add_epi32(s2, dot_u8(_mm512_maskz_loadu_epi8(m, &x2[k]), v));
+            s3 = _mm512_add_epi32(s3, dot_u8(_mm512_maskz_loadu_epi8(m, &x3[k]), v));
+        }
+        dot[i] = (float)_mm512_reduce_add_epi32(s0);
+        dot[i + 1] = (float)_mm512_reduce_add_epi32(s1);
+        dot[i + 2] = (float)_mm512_reduce_add_epi32(s2);
+        dot[i + 3] = (float)_mm512_reduce_add_epi32(s3);
+    }
+    for (; i < n; ++i) {
+        const uint8_t *x0 = &x[(uint64_t)i * d];
+        __m512i s0 = _mm512_setzero_si512();
+        for (int k = 0; k < d; k += 64) {
+            __mmask64 m = mask64(d - k);
+            s0 = _mm512_add_epi32(s0, dot_u8(_mm512_maskz_loadu_epi8(m, &x0[k]), _mm512_maskz_loadu_epi8(m, &q[k])));
+        }
+        dot[i] = (float)_mm512_reduce_add_epi32(s0);
+    }
+}
+
+}  // end namespace avx512
+#pragma GCC pop_options
+#endif  // NNS_SIMD_X86
+
+// -----------------------------------------------------------------------------
+static int detect_simd_level()  // detect simd level of this cpu
+{
+#ifdef NNS_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl")) {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SIMD_AVX2;
+    return SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+int get_simd_level()  // get simd level of this cpu (detected once)
+{
+    static const int level = detect_simd_level();
+    return level;
+}
+
+// -----------------------------------------------------------------------------
+//  the wide kernels are much faster when the rows of a matrix do not cross
+//  cache lines, i.e., when the matrix is aligned and d is a multiple of 16
+// -----------------------------------------------------------------------------
+float *simd_alloc(  // allocate floats aligned to a cache line (64 bytes)
+    uint64_t n)     // number of floats
+{
+    void *p = NULL;
+    if (posix_memalign(&p, 64, sizeof(float) * std::max<uint64_t>(n, 1)) != 0) {
+        printf("Could not allocate %lu floats\n", (unsigned long)n);
+        exit(1);
+    }
+    return (float *)p;
+}
+
+// -----------------------------------------------------------------------------
+void simd_free(  // release floats allocated by simd_alloc()
+    float *p)    // floats
+{
+    free(p);
+}
+
+// -----------------------------------------------------------------------------
+const char *get_simd_name()  // get name of simd level of this cpu
+{
+    switch (get_simd_level()) {
+        case SIMD_AVX512:
+            return "avx512";
+        case SIMD_AVX2:
+            return "avx2";
+        case SIMD_SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void simd_gemv(      // calc y = A x by simd kernels
+    int m,           // number of rows of A
+    int d,           // dimensionality
+    const float *a,  // matrix A (m * d)
+    const DType *x,  // vector x (d)
+    float *y)        // vector y (m) (return)
+{
+#ifdef NNS_SIMD_X86
+    switch (get_simd_level()) {
+        case SIMD_AVX512:
+            avx512::gemv<DType>(m, d, a, x, y);
+            return;
+        case SIMD_AVX2:
+            avx2::gemv<DType>(m, d, a, x, y);
+            return;
+        default:
+            sse2::gemv<DType>(m, d, a, x, y);
+            return;
+    }
+#else
+    gemv_scalar<DType>(m, d, a, x, y);
+#endif
+}
+
+template void simd_gemv<uint8_t>(int, int, const float *, const uint8_t *, float *);
+template void simd_gemv<uint16_t>(int, int, const float *, const uint16_t *, float *);
+template void simd_gemv<int>(int, int, const float *, const int *, float *);
+template void simd_gemv<float>(int, int, const float *, const float *, float *);
+
+// -----------------------------------------------------------------------------
+template <class DType>
+float simd_l2_sqr(    // calc l2 square distance by simd kernels
+    int dim,          // dimension
+    float threshold,  // threshold
+    const DType *p1,  // 1st point
+    const DType *p2)  // 2nd point
+{
+#ifdef NNS_SIMD_X86
+    switch (get_simd_level()) {
+        case SIMD_AVX512:
+            return avx512::l2_sqr(dim, threshold, p1, p2);
+        case SIMD_AVX2:
+            return avx2::l2_sqr(dim, threshold, p1, p2);
+        default:
+            break;
+    }
+#endif
+    return calc_l2_sqr<DType>(dim, threshold, p1, p2);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+float simd_l1_dist(   // calc Manhattan distance (l_1) by simd kernels
+    int dim,          // dimension
+    float threshold,  // threshold
+    const DType *p1,  // 1st point
+    const DType *p2)  // 2nd point
+{
+#ifdef NNS_SIMD_X86
+    switch (get_simd_level()) {
+        case SIMD_AVX512:
+            return avx512::l1_dist(dim, threshold, p1, p2);
+        case SIMD_AVX2:
+            return avx2::l1_dist(dim, threshold, p1, p2);
+        default:
+            break;
+    }
+#endif
+    return calc_l1_dist<DType>(dim, threshold, p1, p2);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+float simd_l0_sqrt(   // calc l_{0.5} sqrt distance by simd kernels
+    int dim,          // dimension
+    float threshold,  // threshold
+    const DType *p1,  // 1st point
+    const DType *p2)  // 2nd point
+{
+#ifdef NNS_SIMD_X86
+    switch (get_simd_level()) {
+        case SIMD_AVX512:
+            return avx512::l0_sqrt(dim, threshold, p1, p2);
+        case SIMD_AVX2:
+            return avx2::l0_sqrt(dim, threshold, p1, p2);
+        default:
+            break;
+    }
+#endif
+    return calc_l0_sqrt<DType>(dim, threshold, p1, p2);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static void dot_batch(  // calc inner products with n points
+    int n,              // number of points
+    int d,              // dimensionality
+    const DType *q,     // query point
+    const DType *x,     // points (n * d)
+    float *dot)         // inner products (return)
+{
+#ifdef NNS_SIMD_X86
+    switch (get_simd_level()) {
+        case SIMD_AVX512:
+            avx512::dot_batch(n, d, q, x, dot);
+            return;
+        case SIMD_AVX2:
+            avx2::dot_batch(n, d, q, x, dot);
+            return;
+        default:
+            break;
+    }
+#endif
+    for (int i = 0; i < n; ++i) {
+        const DType *x0 = &x[(uint64_t)i * d];
+        float r = 0.0f;
+        for (int k = 0; k < d; ++k) r += (float)x0[k] * (float)q[k];
+        dot[i] = r;
+    }
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void simd_l2_sqr_batch(  // calc l2 square distances from a query to n points
+    int n,               // number of points
+    int d,               // dimensionality
+    const DType *query,  // query point
+    const DType *data,   // points (n * d)
+    const float *norms,  // l2 square norms of points (allow NULL)
+    float *dist)         // l2 square distances (return)
+{
+    if (norms != NULL) {
+        // norm expansion: |x - q|^2 = |x|^2 + |q|^2 - 2 <x, q>
+        float q2 = 0.0f;
+        for (int k = 0; k < d; ++k) q2 += SQR((float)query[k]);
+
+        dot_batch(n, d, query, data, dist);
+        for (int i = 0; i < n; ++i) dist[i] = (float)std::max((double)norms[i] + q2 - 2.0 * dist[i], 0.0);
+        return;
+    }
+#ifdef NNS_SIMD_X86
+    switch (get_simd_level()) {
+        case SIMD_AVX512:
+            avx512::l2_sqr_batch(n, d, query, data, dist);
+            return;
+        case SIMD_AVX2:
+            avx2::l2_sqr_batch(n, d, query, data, dist);
+            return;
+        default:
+            break;
+    }
+#endif
+    for (int i = 0; i < n; ++i) dist[i] = calc_l2_sqr<DType>(d, MAXREAL, &data[(uint64_t)i * d], query);
+}
+
+template void simd_l2_sqr_batch<uint8_t>(int, int, const uint8_t *, const uint8_t *, const float *, float *);
+template void simd_l2_sqr_batch<uint16_t>(int, int, const uint16_t *, const uint16_t *, const float *, float *);
+template void simd_l2_sqr_batch<int>(int, int, const int *, const int *, const float *, float *);
+template void simd_l2_sqr_batch<float>(int, int, const float *, const float *, const float *, float *);
+
+// -----------------------------------------------------------------------------
+const float *get_lp_table(  // get table of x^p for x = 0, 1, ..., size-1
+    float p,                // l_p distance, p \in (0,2]
+    int size)               // size of table (256 or 65536)
+{
+    // the last table of each size is cached per thread; tables are built once
+    // and kept until the program exits
+    thread_local float last_p[2] = {-1.0f, -1.0f};
+    thread_local const float *last_table[2] = {NULL, NULL};
+
+    int slot = size > 256 ? 1 : 0;
+    if (last_p[slot] == p) return last_table[slot];
+
+    static std::mutex mutex;
+    static std::map<std::pair<float, int>, std::vector<float> > tables;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<float> &table = tables[std::make_pair(p, size)];
+    if (table.empty()) {
+        table.resize(size);
+        for (int i = 0; i < size; ++i) table[i] = pow((float)i, p);
+    }
+    last_p[slot] = p;
+    last_table[slot] = table.data();
+    return last_table[slot];
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float lp_pow_table(  // calc l_p pow_p distance by table
+    int dim,                // dimension
+    float threshold,        // threshold
+    const float *table,     // table of |a - b|^p
+    const DType *p1,        // 1st point
+    const DType *p2)        // 2nd point
+{
+#ifdef NNS_SIMD_X86
+    switch (get_simd_level()) {
+        case SIMD_AVX512:
+            return avx512::lp_pow(dim, threshold, table, p1, p2);
+        case SIMD_AVX2:
+            return avx2::lp_pow(dim, threshold, table, p1, p2);
+        default:
+            break;
+    }
+#endif
+    float r = 0.0f;
+    int k = 0;
+    while (k < dim) {
+        for (int end = std::min(k + DIST_CHECK, dim); k < end; ++k) {
+            r += table[abs((int)p1[k] - (int)p2[k])];
+        }
+        if (r > threshold) return r;
+    }
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+static float lp_pow(  // calc l_p pow_p distance (int and float)
+    int dim,          // dimension
+    float p,          // l_p distance, p \in (0,2]
+    float threshold,  // threshold
+    const DType *p1,  // 1st point
+    const DType *p2)  // 2nd point
+{
+    return calc_lp_pow<DType>(dim, p, threshold, p1, p2);
+}
+
+static float lp_pow(int dim, float p, float threshold, const uint8_t *p1, const uint8_t *p2) {
+    return lp_pow_table<uint8_t>(dim, threshold, get_lp_table(p, 1 << 8), p1, p2);
+}
+
+static float lp_pow(int dim, float p, float threshold, const uint16_t *p1, const uint16_t *p2) {
+    return lp_pow_table<uint16_t>(dim, threshold, get_lp_table(p, 1 << 16), p1, p2);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+float simd_lp_pow(    // calc l_p pow_p distance by simd kernels
+    int dim,          // dimension
+    float p,          // l_p distance, p \in (0,2]
+    float threshold,  // threshold
+    const DType *p1,  // 1st point
+    const DType *p2)  // 2nd point
+{
+    return lp_pow(dim, p, threshold, p1, p2);
+}
+
+template float simd_lp_pow<uint8_t>(int, float, float, const uint8_t *, const uint8_t *);
+template float simd_lp_pow<uint16_t>(int, float, float, const uint16_t *, const uint16_t *);
+template float simd_lp_pow<int>(int, float, float, const int *, const int *);
+template float simd_lp_pow<float>(int, float, float, const float *, const float *);
+
+template float simd_l2_sqr<uint8_t>(int, float, const uint8_t *, const uint8_t *);
+template float simd_l2_sqr<uint16_t>(int, float, const uint16_t *, const uint16_t *);
+template float simd_l2_sqr<int>(int, float, const int *, const int *);
+template float simd_l2_sqr<float>(int, float, const float *, const float *);
+
+template float simd_l1_dist<uint8_t>(int, float, const uint8_t *, const uint8_t *);
+template float simd_l1_dist<uint16_t>(int, float, const uint16_t *, const uint16_t *);
+template float simd_l1_dist<int>(int, float, const int *, const int *);
+template float simd_l1_dist<float>(int, float, const float *, const float *);
+
+template float simd_l0_sqrt<uint8_t>(int, float, const uint8_t *, const uint8_t *);
+template float simd_l0_sqrt<uint16_t>(int, float, const uint16_t *, const uint16_t *);
+template float simd_l0_sqrt<int>(int, float, const int *, const int *);
+template float simd_l0_sqrt<float>(int, float, const float *, const float *);
+
+}  // end namespace nns
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+
+namespace nns {
+
+// -----------------------------------------------------------------------------
+//  SIMD kernels of projections. the program is compiled for the baseline of
+//  the cpu (e.g., SSE2 on x86-64), while each kernel is compiled for its own
+//  instruction set and the best one supported by the cpu is selected at
+//  runtime (AVX-512, AVX2 or SSE2; scalar on other cpus).
+//
+//  integer coordinates are widened to float in vector registers, and the rows
+//  of a matrix are processed in blocks of four, so that each chunk of x is
+//  loaded and converted once for four rows (a register-blocked GEMV). the
+//  order of summation differs from calc_inner_product().
+// -----------------------------------------------------------------------------
+enum SimdLevel {
+    SIMD_SCALAR = 0,  // no simd
+    SIMD_SSE2 = 1,    // 128-bit
+    SIMD_AVX2 = 2,    // 256-bit with fma
+    SIMD_AVX512 = 3   // 512-bit with fma
+};
+
+// -----------------------------------------------------------------------------
+int get_simd_level();  // get simd level of this cpu (detected once)
+
+// -----------------------------------------------------------------------------
+const char *get_simd_name();  // get name of simd level of this cpu
+
+// -----------------------------------------------------------------------------
+float *simd_alloc(  // allocate floats aligned to a cache line (64 bytes)
+    uint64_t n);    // number of floats
+
+// -----------------------------------------------------------------------------
+void simd_free(  // release floats allocated by simd_alloc()
+    float *p);   // floats
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void simd_gemv(      // calc y = A x by simd kernels
+    int m,           // number of rows of A
+    int d,           // dimensionality
+    const float *a,  // matrix A (m * d)
+    const DType *x,  // vector x (d)
+    float *y);       // vector y (m) (return)
+
+// -----------------------------------------------------------------------------
+//  distance kernels with the same interface as calc_l2_sqr(), calc_l1_dist()
+//  and calc_l0_sqrt() of util.h, which are used as the fallback. the partial
+//  distance is compared with the threshold every DIST_CHECK dimensions.
+// -----------------------------------------------------------------------------
+template <class DType>
+float simd_l2_sqr(     // calc l2 square distance by simd kernels
+    int dim,           // dimension
+    float threshold,   // threshold
+    const DType *p1,   // 1st point
+    const DType *p2);  // 2nd point
+
+// -----------------------------------------------------------------------------
+template <class DType>
+float simd_l1_dist(    // calc Manhattan distance (l_1) by simd kernels
+    int dim,           // dimension
+    float threshold,   // threshold
+    const DType *p1,   // 1st point
+    const DType *p2);  // 2nd point
+
+// -----------------------------------------------------------------------------
+template <class DType>
+float simd_l0_sqrt(    // calc l_{0.5} sqrt distance by simd kernels
+    int dim,           // dimension
+    float threshold,   // threshold
+    const DType *p1,   // 1st point
+    const DType *p2);  // 2nd point
+
+// -----------------------------------------------------------------------------
+//  one-to-many l2 square distances, e.g., for all points of a data page. the
+//  points are processed four at a time against the same chunk of the query.
+//  if the l2 square norms of points are given, the norm expansion |x|^2 +
+//  |q|^2 - 2 <x, q> is used, which needs only one product per coordinate but
+//  is exact only if the sums fit the float mantissa (e.g., uint8 and d <= 258,
+//  see is_exact_norm() of util.h; the terms are combined in double, as |x|^2
+//  + |q|^2 may exceed 2^24); otherwise, (x - q)^2 is accumulated.
+// -----------------------------------------------------------------------------
+template <class DType>
+void simd_l2_sqr_batch(  // calc l2 square distances from a query to n points
+    int n,               // number of points
+    int d,               // dimensionality
+    const DType *query,  // query point
+    const DType *data,   // points (n * d)
+    const float *norms,  // l2 square norms of points (allow NULL)
+    float *dist);        // l2 square distances (return)
+
+// -----------------------------------------------------------------------------
+//  l_p pow_p distance for any p. for uint8 and uint16, |a - b| takes only 256
+//  or 65536 values, so |a - b|^p is read from a table of the given p instead of
+//  calling pow() per coordinate (with gather instructions on AVX2/AVX-512).
+//  int and float use calc_lp_pow() of util.h.
+// -----------------------------------------------------------------------------
+template <class DType>
+float simd_lp_pow(     // calc l_p pow_p distance by simd kernels
+    int dim,           // dimension
+    float p,           // l_p distance, p \in (0,2]
+    float threshold,   // threshold
+    const DType *p1,   // 1st point
+    const DType *p2);  // 2nd point
+
+// -----------------------------------------------------------------------------
+const float *get_lp_table(  // get table of x^p for x = 0, 1, ..., size-1
+    float p,                // l_p distance, p \in (0,2]
+    int size);              // size of table (256 or 65536)
+
+// -----------------------------------------------------------------------------
+template <class DType>
+inline float simd_inner_product(  // calc inner product by simd kernels
+    int d,                        // dimensionality
+    const float *a,               // 1st point
+    const DType *x)               // 2nd point
+{
+    float r = 0.0f;
+    simd_gemv<DType>(1, d, a, x, &r);
+    return r;
+}
+
+}  // end namespace nns
@@ -13,6 +13,86 @@ float g_ratio = -1.0f;    // global param: overall ratio
 float g_recall = -1.0f;   // global param: recall
 uint64_t g_page_io = 0;   // global param: page i/o
 
+int g_locator = 0;      // global param: leaf locator of b+ trees (0-2)
+int g_num_threads = 1;  // global param: number of threads
+int g_mem_cap = 0;      // global param: memory cap (MB) of indexing
+int g_proj = 0;         // global param: projection of hash functions
+int g_dim_order = 0;    // global param: dimension order of new format data
+int g_sketch = 0;       // global param: dimension of pca sketch
+int g_sq_bits = 0;      // global param: bits of scalar quantization codes
+float g_rerank = 2.0f;  // global param: re-rank factor of codes
+
+std::vector<BuildPhase> g_build_phases;  // global param: build phases
+std::string g_build_scope;               // global param: build scope
+
+// -----------------------------------------------------------------------------
+void add_build_phase(  // add time and bytes to a build phase
+    const char *name,  // name of phase (in current scope)
+    double time,       // time (seconds)
+    uint64_t bytes)    // bytes written to disk
+{
+    std::string full_name = g_build_scope.empty() ? name : g_build_scope + "/" + name;
+    for (auto &phase : g_build_phases) {
+        if (phase.name_ == full_name) {
+            phase.time_ += time;
+            phase.bytes_ += bytes;
+            return;
+        }
+    }
+    BuildPhase phase = {full_name, time, bytes};
+    g_build_phases.push_back(phase);
+}
+
+// -----------------------------------------------------------------------------
+uint64_t get_peak_rss()  // get peak resident set size (bytes)
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)usage.ru_maxrss * 1024;  // ru_maxrss is in KB on linux
+}
+
+// -----------------------------------------------------------------------------
+uint64_t get_file_size(  // get file size (bytes)
+    const char *fname)   // file name
+{
+    struct stat st;
+    if (stat(fname, &st) != 0) return 0;
+    return (uint64_t)st.st_size;
+}
+
+// -----------------------------------------------------------------------------
+int write_build_report(   // write build report (json) to disk
+    const char *fname,    // file name
+    const char *method,   // name of method
+    float indexing_time,  // indexing time (seconds)
+    float estimated_mem)  // estimated memory (MB)
+{
+    FILE *fp = fopen(fname, "w");
+    if (!fp) {
+        printf("Could not create %s\n", fname);
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+    for (auto &phase : g_build_phases) bytes += phase.bytes_;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"method\": \"%s\",\n", method);
+    fprintf(fp, "  \"indexing_time\": %f,\n", indexing_time);
+    fprintf(fp, "  \"estimated_mem_mb\": %f,\n", estimated_mem);
+    fprintf(fp, "  \"peak_rss_bytes\": %llu,\n", (unsigned long long)get_peak_rss());
+    fprintf(fp, "  \"bytes_written\": %llu,\n", (unsigned long long)bytes);
+    fprintf(fp, "  \"phases\": [");
+    for (size_t i = 0; i < g_build_phases.size(); ++i) {
+        const BuildPhase &phase = g_build_phases[i];
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"time\": %f, \"bytes\": %llu}", i > 0 ? "," : "",
+                phase.name_.c_str(), phase.time_, (unsigned long long)phase.bytes_);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+    return 0;
+}
+
 // -----------------------------------------------------------------------------
 void create_dir(  // create directory
     char *path)   // input path
@@ -56,14 +136,16 @@ int read_buffer_from_page(  // read buffer from page
     const char *fname,      // file name of data
     char *buffer)           // buffer to store data (return)
 {
-    FILE *fp = fopen(fname, "rb");
-    if (!fp) {
+    // read by the system calls directly, as the page is read only once
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
         printf("Could not open %s\n", fname);
         return 1;
     }
 
-    fread(buffer, sizeof(char), B, fp);
-    fclose(fp);
+    ssize_t size = 0, ret = 0;
+    while (size < B && (ret = read(fd, &buffer[size], B - size)) > 0) size += ret;
+    close(fd);
     return 0;
 }
 
@@ -116,4 +198,128 @@ float calc_recall(        // calc recall (percentage)
     return (i + 1) * 100.0f / k;
 }
 
+// -----------------------------------------------------------------------------
+//  the butterflies of each level are independent, so the inner loop is
+//  vectorized by the compiler once the stride is large enough
+// -----------------------------------------------------------------------------
+void fwht(     // fast walsh-hadamard transform (in place, unnormalized)
+    int n,     // size of transform (power of 2)
+    float *x)  // vector (return)
+{
+    for (int h = 1; h < n; h <<= 1) {
+        for (int i = 0; i < n; i += (h << 1)) {
+            float *lo = x + i;
+            float *hi = x + i + h;
+            for (int j = 0; j < h; ++j) {
+                float a = lo[j];
+                float b = hi[j];
+                lo[j] = a + b;
+                hi[j] = a - b;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+int *read_dim_order(      // read dimension order of new format data
+    int d,                // dimensionality
+    const char *dfolder)  // data folder
+{
+    char fname[200];
+    sprintf(fname, "%sorder", dfolder);
+    FILE *fp = fopen(fname, "r");
+    if (!fp) return NULL;  // storage order
+
+    int dim = -1;
+    int *order = new int[d];
+    bool ok = fscanf(fp, "d = %d\n", &dim) == 1 && dim == d;
+    for (int i = 0; ok && i < d; ++i) {
+        ok = fscanf(fp, "%d", &order[i]) == 1 && order[i] >= 0 && order[i] < d;
+    }
+    fclose(fp);
+
+    if (!ok) {
+        printf("Could not read the dimension order of %d dims from %s\n", d, fname);
+        exit(1);
+    }
+    return order;
+}
+
+// -----------------------------------------------------------------------------
+int write_dim_order(      // write dimension order of new format data
+    int d,                // dimensionality
+    const int *order,     // dimension order
+    const char *dfolder)  // data folder
+{
+    char fname[200];
+    sprintf(fname, "%sorder", dfolder);
+    FILE *fp = fopen(fname, "w");
+    if (!fp) {
+        printf("Could not create %s\n", fname);
+        return 1;
+    }
+    fprintf(fp, "d = %d\n", d);
+    for (int i = 0; i < d; ++i) fprintf(fp, "%d\n", order[i]);
+    fclose(fp);
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+//  subspace iteration: the r vectors start from the unit vectors of the r
+//  dimensions of largest variance, and are multiplied by the covariance matrix
+//  and orthonormalized by Gram-Schmidt in each iteration. the sketch only needs
+//  an orthonormal basis of the subspace, so no rotation within the subspace is
+//  computed. a vector that vanishes (rank < r) is left as zero, which still
+//  gives a lower bound.
+// -----------------------------------------------------------------------------
+void calc_principal_components(  // calc top-r principal components
+    int d,                       // dimensionality
+    int r,                       // number of principal components
+    const float *cov,            // covariance matrix (d * d)
+    float *basis)                // principal components (r * d) (return)
+{
+    std::vector<std::pair<float, int> > var(d);
+    for (int j = 0; j < d; ++j) var[j] = std::make_pair(-cov[(uint64_t)j * d + j], j);
+    std::sort(var.begin(), var.end());
+
+    float *q = basis;
+    float *z = simd_alloc((uint64_t)r * d);
+    float *tmp = new float[r];
+    memset(q, 0, (uint64_t)r * d * sizeof(float));
+    for (int i = 0; i < r; ++i) q[(uint64_t)i * d + var[i].second] = 1.0f;
+
+    for (int iter = 0; iter < PCA_ITER; ++iter) {
+        // (z_i)_j = <q_i, C_j> = (C q_i)_j as C is symmetric
+        for (int j = 0; j < d; ++j) {
+            simd_gemv<float>(r, d, q, &cov[(uint64_t)j * d], tmp);
+            for (int i = 0; i < r; ++i) z[(uint64_t)i * d + j] = tmp[i];
+        }
+        // orthonormalize z_i by modified Gram-Schmidt
+        for (int i = 0; i < r; ++i) {
+            float *zi = &z[(uint64_t)i * d];
+            double norm0 = 0.0;
+            for (int k = 0; k < d; ++k) norm0 += SQR((double)zi[k]);
+
+            for (int t = 0; t < i; ++t) {
+                const float *zt = &z[(uint64_t)t * d];
+                double dot = 0.0;
+                for (int k = 0; k < d; ++k) dot += (double)zi[k] * zt[k];
+                for (int k = 0; k < d; ++k) zi[k] -= (float)dot * zt[k];
+            }
+            double norm = 0.0;
+            for (int k = 0; k < d; ++k) norm += SQR((double)zi[k]);
+
+            if (norm <= 1e-12 * norm0) {  // also if z_i = 0
+                memset(zi, 0, d * sizeof(float));
+            } else {
+                float inv = (float)(1.0 / sqrt(norm));
+                for (int k = 0; k < d; ++k) zi[k] *= inv;
+            }
+        }
+        memcpy(q, z, (uint64_t)r * d * sizeof(float));
+    }
+    simd_free(z);
+    delete[] tmp;
+}
+
 }  // end namespace nns
@@ -1,23 +1,43 @@
 #pragma once
 
+#include <fcntl.h>
 #include <stdarg.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
+#include "bounded_queue.h"
 #include "def.h"
 #include "pri_queue.h"
+#include "simd.h"
 
 namespace nns {
 
+// -----------------------------------------------------------------------------
+//  BuildPhase: time and bytes written of one phase of indexing. the phases of
+//  an inner index (e.g., the qalsh of each block of qalsh+) are named with the
+//  scope of the outer phase, e.g., "block_build/sort".
+// -----------------------------------------------------------------------------
+struct BuildPhase {
+    std::string name_;  // name of phase
+    double time_;       // time (seconds, summed over threads)
+    uint64_t bytes_;    // bytes written to disk
+};
+
 extern timeval g_start_time;  // global param: start time
 extern timeval g_end_time;    // global param: end   time
 
@@ -29,6 +49,45 @@ extern float g_ratio;       // global param: overall ratio
 extern float g_recall;      // global param: recall
 extern uint64_t g_page_io;  // global param: page i/o
 
+extern int g_locator;      // global param: leaf locator of b+ trees (0-2)
+extern int g_num_threads;  // global param: number of threads
+extern int g_mem_cap;      // global param: memory cap (MB) of indexing
+extern int g_proj;         // global param: projection of hash functions
+extern int g_dim_order;    // global param: dimension order of new format data
+extern int g_sketch;       // global param: dimension of pca sketch
+extern int g_sq_bits;      // global param: bits of scalar quantization codes
+extern float g_rerank;     // global param: re-rank factor of codes
+
+extern std::vector<BuildPhase> g_build_phases;  // global param: build phases
+extern std::string g_build_scope;               // global param: build scope
+
+// -----------------------------------------------------------------------------
+inline double get_time() {  // get wall-clock time (seconds)
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / 1000000.0;
+}
+
+// -----------------------------------------------------------------------------
+void add_build_phase(  // add time and bytes to a build phase
+    const char *name,  // name of phase (in current scope)
+    double time,       // time (seconds)
+    uint64_t bytes);   // bytes written to disk
+
+// -----------------------------------------------------------------------------
+uint64_t get_peak_rss();  // get peak resident set size (bytes)
+
+// -----------------------------------------------------------------------------
+uint64_t get_file_size(  // get file size (bytes)
+    const char *fname);  // file name
+
+// -----------------------------------------------------------------------------
+int write_build_report(    // write build report (json) to disk
+    const char *fname,     // file name
+    const char *method,    // name of method
+    float indexing_time,   // indexing time (seconds)
+    float estimated_mem);  // estimated memory (MB)
+
 // -------------------------------------------------------------------------
 void create_dir(  // create directory
     char *path);  // input path
@@ -65,6 +124,29 @@ float calc_recall(        // calc recall (percentage)
     const Result *truth,  // ground truth results
     MinK_List *list);     // results returned by algorithms
 
+// -----------------------------------------------------------------------------
+void fwht(      // fast walsh-hadamard transform (in place, unnormalized)
+    int n,      // size of transform (power of 2)
+    float *x);  // vector (return)
+
+// -----------------------------------------------------------------------------
+int *read_dim_order(       // read dimension order of new format data
+    int d,                 // dimensionality
+    const char *dfolder);  // data folder
+
+// -----------------------------------------------------------------------------
+int write_dim_order(       // write dimension order of new format data
+    int d,                 // dimensionality
+    const int *order,      // dimension order
+    const char *dfolder);  // data folder
+
+// -----------------------------------------------------------------------------
+void calc_principal_components(  // calc top-r principal components
+    int d,                       // dimensionality
+    int r,                       // number of principal components
+    const float *cov,            // covariance matrix (d * d)
+    float *basis);               // principal components (r * d) (return)
+
 // -----------------------------------------------------------------------------
 template <class DType>
 int read_data(           // read data (binary) from disk
@@ -103,6 +185,208 @@ int read_data(           // read data (binary) from disk
     return 0;
 }
 
+// -----------------------------------------------------------------------------
+//  dimension order of new format data: with -do 1, the dimensions are sorted
+//  by decreasing variance when the data pages are written, so that the partial
+//  distances of the kernels cross the threshold of early abandon earlier. the
+//  order is kept in <dfolder>order and applied to the data and queries of all
+//  methods on this data folder (l_p distances do not depend on it).
+// -----------------------------------------------------------------------------
+template <class DType>
+int calc_dim_order(      // calc dimensions sorted by decreasing variance
+    int n,               // number of data points
+    int d,               // dimensionality
+    const char *prefix,  // prefix of data set (used if data is NULL)
+    const DType *data,   // data points (NULL: read from disk by chunks)
+    int *order)          // dimension order (return)
+{
+    const int CHUNK = 65536;  // number of points read at a time
+    FILE *fp = NULL;
+    DType *chunk = NULL;
+    if (data == NULL) {
+        char fname[200];
+        sprintf(fname, "%s.ds", prefix);
+        fp = fopen(fname, "rb");
+        if (!fp) {
+            printf("Could not open %s\n", fname);
+            return 1;
+        }
+        chunk = new DType[(uint64_t)CHUNK * d];
+    }
+    double *sum = new double[d];
+    double *sum2 = new double[d];
+    memset(sum, 0, d * sizeof(double));
+    memset(sum2, 0, d * sizeof(double));
+
+    for (int start = 0; start < n; start += CHUNK) {
+        int num = std::min(CHUNK, n - start);
+        const DType *x = chunk;
+        if (fp == NULL) {
+            x = &data[(uint64_t)start * d];
+        } else if (fread(chunk, sizeof(DType), (uint64_t)num * d, fp) != (uint64_t)num * d) {
+            printf("Could not read %d data points from %s.ds\n", n, prefix);
+            exit(1);
+        }
+        for (int i = 0; i < num; ++i) {
+            for (int j = 0; j < d; ++j) {
+                double v = (double)x[(uint64_t)i * d + j];
+                sum[j] += v;
+                sum2[j] += v * v;
+            }
+        }
+    }
+    if (fp != NULL) {
+        fclose(fp);
+        delete[] chunk;
+    }
+
+    std::vector<std::pair<double, int> > var(d);
+    for (int j = 0; j < d; ++j) {
+        double mean = sum[j] / n;
+        var[j] = std::make_pair(-(sum2[j] / n - mean * mean), j);
+    }
+    std::sort(var.begin(), var.end());  // decreasing variance, ties by dim
+    for (int j = 0; j < d; ++j) order[j] = var[j].second;
+
+    delete[] sum;
+    delete[] sum2;
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void reorder_dims(     // reorder the dimensions of points, x'[j] = x[order[j]]
+    int n,             // number of points
+    int d,             // dimensionality
+    const int *order,  // dimension order
+    DType *data)       // points (return)
+{
+    DType *tmp = new DType[d];
+    for (int i = 0; i < n; ++i) {
+        DType *x = &data[(uint64_t)i * d];
+        for (int j = 0; j < d; ++j) tmp[j] = x[order[j]];
+        memcpy(x, tmp, d * sizeof(DType));
+    }
+    delete[] tmp;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+int *get_dim_order(       // get dimension order of new format data
+    int n,                // number of data points
+    int d,                // dimensionality
+    bool build,           // will the new format data be written?
+    const char *prefix,   // prefix of data set
+    const char *dfolder,  // data folder
+    const DType *data)    // data points (NULL: read from disk by chunks)
+{
+    int *order = read_dim_order(d, dfolder);
+    if (order != NULL || g_dim_order == 0 || !build) return order;
+
+    char dpath[200];
+    sprintf(dpath, "%sdata/", dfolder);
+    if (access(dpath, F_OK) == 0) {
+        printf("New format data exist in storage order, dimension order ignored.\n");
+        return NULL;
+    }
+    order = new int[d];
+    if (calc_dim_order<DType>(n, d, prefix, data, order) || write_dim_order(d, order, dfolder)) exit(1);
+    return order;
+}
+
+// -----------------------------------------------------------------------------
+//  pca basis of a sample of at most PCA_SAMPLE points, evenly spaced over the
+//  data set. the points read from disk are put into the dimension order of the
+//  new format data, so the basis is in the same space as the pages.
+// -----------------------------------------------------------------------------
+template <class DType>
+int calc_pca_basis(       // calc pca basis from a sample of data points
+    int n,                // number of data points
+    int d,                // dimensionality
+    int r,                // number of principal components
+    const char *prefix,   // prefix of data set (used if data is NULL)
+    const char *dfolder,  // data folder (used if data is NULL)
+    const DType *data,    // data points (NULL: read from disk)
+    float *basis)         // principal components (r * d) (return)
+{
+    int num = std::min(n, PCA_SAMPLE);
+    DType *sample = new DType[(uint64_t)num * d];
+    if (data != NULL) {
+        for (int i = 0; i < num; ++i) {
+            uint64_t id = (uint64_t)i * n / num;
+            memcpy(&sample[(uint64_t)i * d], &data[id * d], d * sizeof(DType));
+        }
+    } else {
+        char fname[200];
+        sprintf(fname, "%s.ds", prefix);
+        FILE *fp = fopen(fname, "rb");
+        if (!fp) {
+            printf("Could not open %s\n", fname);
+            delete[] sample;
+            return 1;
+        }
+        for (int i = 0; i < num; ++i) {
+            uint64_t id = (uint64_t)i * n / num;
+            fseek(fp, id * d * sizeof(DType), SEEK_SET);
+            if (fread(&sample[(uint64_t)i * d], sizeof(DType), d, fp) != (size_t)d) {
+                printf("Could not read %d data points from %s.ds\n", n, prefix);
+                fclose(fp);
+                delete[] sample;
+                return 1;
+            }
+        }
+        fclose(fp);
+
+        int *order = read_dim_order(d, dfolder);
+        if (order != NULL) {
+            reorder_dims<DType>(num, d, (const int *)order, sample);
+            delete[] order;
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    //  covariance matrix of the sample. the centered points are transposed in
+    //  tiles of PCA_TILE points, so that row j of a tile's C = X^T X is a gemv
+    //  of the tile by its j-th row. tiles are summed up in double.
+    // -------------------------------------------------------------------------
+    double *mean = new double[d];
+    memset(mean, 0, d * sizeof(double));
+    for (int i = 0; i < num; ++i) {
+        for (int j = 0; j < d; ++j) mean[j] += (double)sample[(uint64_t)i * d + j];
+    }
+    for (int j = 0; j < d; ++j) mean[j] /= num;
+
+    float *tile = simd_alloc((uint64_t)d * PCA_TILE);  // d * PCA_TILE
+    float *row = new float[d];
+    double *sum = new double[(uint64_t)d * d];
+    memset(sum, 0, (uint64_t)d * d * sizeof(double));
+
+    for (int start = 0; start < num; start += PCA_TILE) {
+        int m = std::min(PCA_TILE, num - start);
+        memset(tile, 0, (uint64_t)d * PCA_TILE * sizeof(float));
+        for (int i = 0; i < m; ++i) {
+            const DType *x = &sample[(uint64_t)(start + i) * d];
+            for (int j = 0; j < d; ++j) tile[(uint64_t)j * PCA_TILE + i] = (float)(x[j] - mean[j]);
+        }
+        for (int j = 0; j < d; ++j) {
+            simd_gemv<float>(d, PCA_TILE, tile, &tile[(uint64_t)j * PCA_TILE], row);
+            double *acc = &sum[(uint64_t)j * d];
+            for (int k = 0; k < d; ++k) acc[k] += row[k];
+        }
+    }
+    float *cov = simd_alloc((uint64_t)d * d);
+    for (uint64_t i = 0; i < (uint64_t)d * d; ++i) cov[i] = (float)(sum[i] / num);
+    calc_principal_components(d, r, (const float *)cov, basis);
+
+    delete[] sample;
+    delete[] mean;
+    delete[] row;
+    delete[] sum;
+    simd_free(tile);
+    simd_free(cov);
+    return 0;
+}
+
 // -----------------------------------------------------------------------------
 template <class DType>
 inline void write_data_to_buffer(  // write data to buffer
@@ -119,6 +403,36 @@ inline void write_data_to_buffer(  // write data to buffer
     }
 }
 
+// -----------------------------------------------------------------------------
+template <class DType>
+int write_data_pages(   // write data points into pages of new format
+    int n,              // number of data points
+    int d,              // data dimension
+    int B,              // page size
+    int fid,            // id of the first page
+    const DType *data,  // data points
+    const char *dpath,  // path of pages
+    char *buffer)       // buffer of one page
+{
+    // compute num of data in one page
+    int num = (int)floor((float)B / (d * sizeof(DType)));
+
+    int start = 0;
+    while (start < n) {
+        // write data to buffer
+        if (start + num > n) num = n - start;
+        write_data_to_buffer<DType>(num, d, &data[(uint64_t)start * d], buffer);
+
+        // write one page of data to disk
+        char fname[200];
+        sprintf(fname, "%s%d.data", dpath, fid++);
+        write_buffer_to_page(B, fname, (const char *)buffer);
+        start += num;
+    }
+    assert(start == n);
+    return fid;  // id of the next page
+}
+
 // -----------------------------------------------------------------------------
 template <class DType>
 int write_data_new_form(  // write dataset with new format
@@ -138,29 +452,15 @@ int write_data_new_form(  // write dataset with new format
     }
     create_dir(dpath);
 
-    // compute num of data in one page and total number of data file
-    int num = (int)floor((float)B / (d * sizeof(DType)));
-    int total_file = (int)ceil((float)n / num);
-    assert(total_file > 0);
-
     // write new format data for qalsh
+    double start_time = get_time();
     char *buffer = new char[B];
     memset(buffer, 0, B * sizeof(char));  // one page
 
-    int start = 0;
-    for (int i = 0; i < total_file; ++i) {
-        // write data to buffer
-        if (start + num > n) num = n - start;
-        write_data_to_buffer<DType>(num, d, &data[(uint64_t)start * d], buffer);
-
-        // write one page of data to disk
-        char fname[200];
-        sprintf(fname, "%s%d.data", dpath, i);
-        write_buffer_to_page(B, fname, (const char *)buffer);
-        start += num;
-    }
-    assert(start == n);
+    int total_file = write_data_pages<DType>(n, d, B, 0, data, dpath, buffer);
+    assert(total_file > 0);
     delete[] buffer;
+    add_build_phase("data_write", get_time() - start_time, (uint64_t)total_file * B);
 
     return 0;
 }
@@ -223,6 +523,70 @@ float calc_inner_product(  // calc inner product
     return r;
 }
 
+// -----------------------------------------------------------------------------
+template <class DType>
+float calc_sparse_product(  // calc inner product with a sparse vector
+    int nnz,                // number of non-zeros of sparse vector
+    const int *idx,         // indices of non-zeros
+    const float *val,       // values of non-zeros
+    const DType *data)      // dense point
+{
+    float r = 0.0f;
+    for (int i = 0; i < nnz; ++i) {
+        r += val[i] * (float)data[idx[i]];
+    }
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+//  calc the projections of a tile of points on a group of hash functions (a
+//  small GEMM). the tile is converted to float once and stored in dimension-
+//  major order, so each hash function is applied to all points of the tile
+//  by a SIMD-friendly loop. dimensions are processed block by block to keep
+//  the tile and the hash functions in cache. for each (hash function, point)
+//  pair, the order of summation is the same as calc_inner_product().
+//
+//  NOTE: loop vectorization is disabled here, as gcc otherwise vectorizes the
+//  loop over dimensions with costly shuffles; the loop over the points of the
+//  tile is still vectorized by slp.
+// -----------------------------------------------------------------------------
+template <class DType>
+__attribute__((optimize("no-tree-loop-vectorize")))
+void calc_proj_tile(    // calc projections of a tile of points
+    int n,              // number of points in this tile (n <= PROJ_TILE)
+    int d,              // dimensionality
+    int m,              // number of hash functions
+    const float *a,     // hash functions (m * d)
+    const DType *data,  // points of this tile (n * d)
+    float *buf,         // buffer for the tile (d * PROJ_TILE)
+    float *proj)        // projections (m * PROJ_TILE) (return)
+{
+    assert(n > 0 && n <= PROJ_TILE);
+    for (int j = 0; j < n; ++j) {
+        const DType *x = &data[(uint64_t)j * d];
+        for (int i = 0; i < d; ++i) buf[i * PROJ_TILE + j] = (float)x[i];
+    }
+    for (int j = n; j < PROJ_TILE; ++j) {
+        for (int i = 0; i < d; ++i) buf[i * PROJ_TILE + j] = 0.0f;
+    }
+    memset(proj, 0, m * PROJ_TILE * sizeof(float));
+
+    for (int start = 0; start < d; start += PROJ_BLOCK) {
+        int end = std::min(start + PROJ_BLOCK, d);
+        for (int t = 0; t < m; ++t) {
+            const float *at = &a[(uint64_t)t * d];
+            float r[PROJ_TILE];  // keep the projections in registers
+            memcpy(r, &proj[t * PROJ_TILE], PROJ_TILE * sizeof(float));
+            for (int i = start; i < end; ++i) {
+                const float ai = at[i];
+                const float *x = &buf[i * PROJ_TILE];
+                for (int j = 0; j < PROJ_TILE; ++j) r[j] += ai * x[j];
+            }
+            memcpy(&proj[t * PROJ_TILE], r, PROJ_TILE * sizeof(float));
+        }
+    }
+}
+
 // -----------------------------------------------------------------------------
 template <class DType>
 float calc_l2_sqr(    // calc l2 square distance
@@ -488,6 +852,191 @@ float calc_lp_pow(    // calc l_p pow_p distance
     return r;
 }
 
+// -----------------------------------------------------------------------------
+//  metric policies of l_p distance: dist() is calc_lp_dist() for one kind of p.
+//  search loops are templated on a policy, so that the kernel is called
+//  directly instead of testing p for every distance, and the policy is chosen
+//  once per query by get_metric().
+// -----------------------------------------------------------------------------
+enum MetricType {
+    METRIC_L2 = 0,   // p = 2
+    METRIC_L1 = 1,   // p = 1
+    METRIC_L05 = 2,  // p = 0.5
+    METRIC_LP = 3    // other p
+};
+
+// -----------------------------------------------------------------------------
+inline int get_metric(  // get metric type of l_p distance
+    float p)            // l_p distance, p \in (0,2]
+{
+    if (fabs(p - 2.0f) < FLOATZERO) return METRIC_L2;
+    if (fabs(p - 1.0f) < FLOATZERO) return METRIC_L1;
+    if (fabs(p - 0.5f) < FLOATZERO) return METRIC_L05;
+    return METRIC_LP;
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+inline bool is_exact_norm(  // is l2 norm expansion exact in float?
+    int d)                  // dimensionality
+{
+    // |x|^2, |q|^2, <x, q> and |x - q|^2 are integers below 2^24 for uint8 data
+    // with d <= 258, so each of them is exact in float. |x|^2 + |q|^2 may not
+    // be, so simd_l2_sqr_batch() combines them in double.
+    return std::is_same<DType, uint8_t>::value && d <= (1 << 24) / (255 * 255);
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void calc_l2_norms(     // calc l2 square norms of data points
+    int n,              // number of data points
+    int d,              // dimensionality
+    const DType *data,  // data points
+    float *norms)       // l2 square norms (return)
+{
+    for (int i = 0; i < n; ++i) {
+        const DType *x = &data[(uint64_t)i * d];
+        double r = 0.0;
+        for (int j = 0; j < d; ++j) r += SQR((double)x[j]);
+        norms[i] = (float)r;
+    }
+}
+
+// -----------------------------------------------------------------------------
+template <class Metric, class DType>
+inline void calc_dist_one_by_one(  // calc distances from a query to n points
+    int n,                         // number of points
+    int dim,                       // dimension
+    float p,                       // l_p distance, p \in (0,2]
+    float threshold,               // threshold
+    const DType *query,            // query point
+    const DType *data,             // points (n * dim)
+    float *dists)                  // distances (return)
+{
+    for (int i = 0; i < n; ++i) {
+        dists[i] = Metric::template dist<DType>(dim, p, threshold, &data[(uint64_t)i * dim], query);
+    }
+}
+
+// -----------------------------------------------------------------------------
+//  besides dist(), each policy provides dist_batch() for the distances from a
+//  query to n consecutive points. the threshold is an upper bound of interest
+//  for early abandon, and norms are the l2 square norms of points (L2 only).
+// -----------------------------------------------------------------------------
+struct L2Metric {
+    template <class DType>
+    static inline float dist(  // calc l_2 distance
+        int dim,               // dimension
+        float p,               // l_p distance (unused)
+        float threshold,       // threshold
+        const DType *p1,       // 1st point
+        const DType *p2)       // 2nd point
+    {
+        return sqrt(simd_l2_sqr<DType>(dim, SQR(threshold), p1, p2));
+    }
+
+    template <class DType>
+    static inline void dist_batch(  // calc l_2 distances to n points
+        int n,                      // number of points
+        int dim,                    // dimension
+        float p,                    // l_p distance (unused)
+        float threshold,            // threshold (unused)
+        const DType *query,         // query point
+        const DType *data,          // points (n * dim)
+        const float *norms,         // l2 square norms of points (allow NULL)
+        float *dists)               // distances (return)
+    {
+        simd_l2_sqr_batch<DType>(n, dim, query, data, norms, dists);
+        for (int i = 0; i < n; ++i) dists[i] = sqrt(dists[i]);
+    }
+};
+
+// -----------------------------------------------------------------------------
+struct L1Metric {
+    template <class DType>
+    static inline float dist(  // calc l_1 distance
+        int dim,               // dimension
+        float p,               // l_p distance (unused)
+        float threshold,       // threshold
+        const DType *p1,       // 1st point
+        const DType *p2)       // 2nd point
+    {
+        return simd_l1_dist<DType>(dim, threshold, p1, p2);
+    }
+
+    template <class DType>
+    static inline void dist_batch(  // calc l_p distances to n points
+        int n,                      // number of points
+        int dim,                    // dimension
+        float p,                    // l_p distance, p \in (0,2]
+        float threshold,            // threshold
+        const DType *query,         // query point
+        const DType *data,          // points (n * dim)
+        const float *norms,         // l2 square norms of points (unused)
+        float *dists)               // distances (return)
+    {
+        calc_dist_one_by_one<L1Metric, DType>(n, dim, p, threshold, query, data, dists);
+    }
+};
+
+// -----------------------------------------------------------------------------
+struct L05Metric {
+    template <class DType>
+    static inline float dist(  // calc l_{0.5} distance
+        int dim,               // dimension
+        float p,               // l_p distance (unused)
+        float threshold,       // threshold
+        const DType *p1,       // 1st point
+        const DType *p2)       // 2nd point
+    {
+        float ret = simd_l0_sqrt<DType>(dim, sqrt(threshold), p1, p2);
+        return SQR(ret);
+    }
+
+    template <class DType>
+    static inline void dist_batch(  // calc l_p distances to n points
+        int n,                      // number of points
+        int dim,                    // dimension
+        float p,                    // l_p distance, p \in (0,2]
+        float threshold,            // threshold
+        const DType *query,         // query point
+        const DType *data,          // points (n * dim)
+        const float *norms,         // l2 square norms of points (unused)
+        float *dists)               // distances (return)
+    {
+        calc_dist_one_by_one<L05Metric, DType>(n, dim, p, threshold, query, data, dists);
+    }
+};
+
+// -----------------------------------------------------------------------------
+struct LpMetric {
+    template <class DType>
+    static inline float dist(  // calc l_p distance
+        int dim,               // dimension
+        float p,               // l_p distance, p \in (0,2]
+        float threshold,       // threshold
+        const DType *p1,       // 1st point
+        const DType *p2)       // 2nd point
+    {
+        float ret = simd_lp_pow<DType>(dim, p, pow(threshold, p), p1, p2);
+        return pow(ret, 1.0f / p);
+    }
+
+    template <class DType>
+    static inline void dist_batch(  // calc l_p distances to n points
+        int n,                      // number of points
+        int dim,                    // dimension
+        float p,                    // l_p distance, p \in (0,2]
+        float threshold,            // threshold
+        const DType *query,         // query point
+        const DType *data,          // points (n * dim)
+        const float *norms,         // l2 square norms of points (unused)
+        float *dists)               // distances (return)
+    {
+        calc_dist_one_by_one<LpMetric, DType>(n, dim, p, threshold, query, data, dists);
+    }
+};
+
 // -----------------------------------------------------------------------------
 template <class DType>
 float calc_lp_dist(   // calc l_p distance
@@ -497,89 +1046,334 @@ float calc_lp_dist(   // calc l_p distance
     const DType *p1,  // 1st point
     const DType *p2)  // 2nd point
 {
-    if (fabs(p - 2.0f) < FLOATZERO) {
-        return sqrt(calc_l2_sqr<DType>(dim, SQR(threshold), p1, p2));
-    } else if (fabs(p - 1.0f) < FLOATZERO) {
-        return calc_l1_dist<DType>(dim, threshold, p1, p2);
-    } else if (fabs(p - 0.5f) < FLOATZERO) {
-        float ret = calc_l0_sqrt<DType>(dim, sqrt(threshold), p1, p2);
-        return SQR(ret);
-    } else {
-        float ret = calc_lp_pow<DType>(dim, p, pow(threshold, p), p1, p2);
-        return pow(ret, 1.0f / p);
+    switch (get_metric(p)) {
+        case METRIC_L2:
+            return L2Metric::dist<DType>(dim, p, threshold, p1, p2);
+        case METRIC_L1:
+            return L1Metric::dist<DType>(dim, p, threshold, p1, p2);
+        case METRIC_L05:
+            return L05Metric::dist<DType>(dim, p, threshold, p1, p2);
+        default:
+            return LpMetric::dist<DType>(dim, p, threshold, p1, p2);
     }
 }
 
 // -----------------------------------------------------------------------------
 template <class DType>
-void kNN_search(         // k-NN search
-    int n,               // cardinality
-    int d,               // dimensionality
-    int k,               // top-k value
-    float p,             // l_p distance, p \in (0,2]
-    const DType *data,   // data points
-    const DType *query,  // query point
-    MinK_List *list)     // top-k results (return)
+inline void calc_dist_batch(  // calc l_p distances from a query to n points
+    int n,                    // number of points
+    int dim,                  // dimension
+    float p,                  // l_p distance, p \in (0,2]
+    float threshold,          // threshold
+    const DType *query,       // query point
+    const DType *data,        // points (n * dim)
+    const float *norms,       // l2 square norms of points (allow NULL)
+    float *dists)             // distances (return)
+{
+    switch (get_metric(p)) {
+        case METRIC_L2:
+            L2Metric::dist_batch<DType>(n, dim, p, threshold, query, data, norms, dists);
+            break;
+        case METRIC_L1:
+            L1Metric::dist_batch<DType>(n, dim, p, threshold, query, data, NULL, dists);
+            break;
+        case METRIC_L05:
+            L05Metric::dist_batch<DType>(n, dim, p, threshold, query, data, NULL, dists);
+            break;
+        default:
+            LpMetric::dist_batch<DType>(n, dim, p, threshold, query, data, NULL, dists);
+            break;
+    }
+}
+
+// -----------------------------------------------------------------------------
+template <class DType, class Metric>
+void kNN_search(                // k-NN search (for one metric)
+    int n,                      // cardinality
+    int d,                      // dimensionality
+    int k,                      // top-k value
+    float p,                    // l_p distance, p \in (0,2]
+    const DType *data,          // data points
+    const DType *query,         // query point
+    MinK_List *list,            // top-k results (return)
+    const float *norms = NULL)  // l2 square norms of data points (allow NULL)
 {
-    float dist = -1.0f, kdist = MAXREAL;
+    float dists[DIST_BATCH];
+    float kdist = MAXREAL;
     list->reset();
-    for (int j = 0; j < n; ++j) {
+    for (int j = 0; j < n; j += DIST_BATCH) {
+        int num = std::min(DIST_BATCH, n - j);
+        Metric::template dist_batch<DType>(num, d, p, kdist, query, &data[(uint64_t)j * d],
+                                           norms != NULL ? &norms[j] : NULL, dists);
         // data ID starts from 0
-        dist = calc_lp_dist<DType>(d, p, kdist, &data[(uint64_t)j * d], query);
-        kdist = list->insert(dist, j);
+        kdist = list->insert_batch(num, dists, j);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template <class DType>
+void kNN_search(                // k-NN search
+    int n,                      // cardinality
+    int d,                      // dimensionality
+    int k,                      // top-k value
+    float p,                    // l_p distance, p \in (0,2]
+    const DType *data,          // data points
+    const DType *query,         // query point
+    MinK_List *list,            // top-k results (return)
+    const float *norms = NULL)  // l2 square norms of data points (allow NULL)
+{
+    switch (get_metric(p)) {
+        case METRIC_L2:
+            kNN_search<DType, L2Metric>(n, d, k, p, data, query, list, norms);
+            break;
+        case METRIC_L1:
+            kNN_search<DType, L1Metric>(n, d, k, p, data, query, list);
+            break;
+        case METRIC_L05:
+            kNN_search<DType, L05Metric>(n, d, k, p, data, query, list);
+            break;
+        default:
+            kNN_search<DType, LpMetric>(n, d, k, p, data, query, list);
+            break;
+    }
+}
+
+// -----------------------------------------------------------------------------
+//  k-NN search of all queries under several l_p distances by <g_num_threads>
+//  threads in one pass over the data. the queries are split into tiles of
+//  GT_QTILE queries and the data into partitions, and each thread takes the
+//  next pair of (tile, partition). a partition is scanned in tiles of at most
+//  GT_DTILE bytes, and each data tile stays in cache while the queries of the
+//  tile are verified against it under all distances. the data are split only
+//  if there are fewer query tiles than threads, and the lists of partitions
+//  are merged in the order of ids, so the results are the same as the ones of
+//  kNN_search() for each p.
+// -----------------------------------------------------------------------------
+template <class DType>
+void kNN_join(                  // k-NN search of all queries
+    int n,                      // cardinality
+    int qn,                     // number of queries
+    int d,                      // dimensionality
+    int k,                      // top-k value
+    int np,                     // number of l_p distances
+    const float *p,             // l_p distances, p \in (0,2] (np)
+    const DType *data,          // data points
+    const DType *query,         // query points
+    MinK_List **lists,          // top-k results of queries (np * qn) (return)
+    const float *norms = NULL)  // l2 square norms of data points (allow NULL)
+{
+    int num_tiles = (qn + GT_QTILE - 1) / GT_QTILE;
+    int tile = (int)(GT_DTILE / ((uint64_t)d * sizeof(DType)));
+    tile = std::max(DIST_BATCH, tile - tile % DIST_BATCH);
+
+    int num_parts = std::max(1, (g_num_threads + num_tiles - 1) / num_tiles);
+    num_parts = std::min(num_parts, (n + tile - 1) / tile);
+    int part = (n + num_parts - 1) / num_parts;
+    part = (part + DIST_BATCH - 1) / DIST_BATCH * DIST_BATCH;
+    num_parts = (n + part - 1) / part;
+
+    // top-k results of queries in each partition (the results if no split)
+    uint64_t num_lists = (uint64_t)np * qn;
+    MinK_List **part_lists = lists;
+    if (num_parts > 1) {
+        part_lists = new MinK_List *[num_lists * num_parts];
+        for (uint64_t i = 0; i < num_lists * num_parts; ++i) part_lists[i] = new MinK_List(k);
+    }
+
+    int num_tasks = num_tiles * num_parts;
+    int num_threads = std::max(1, std::min(g_num_threads, num_tasks));
+    std::atomic<int> next_task(0);
+
+    auto worker = [&]() {
+        float dists[DIST_BATCH];
+        float *kdists = new float[GT_QTILE * np];  // k-th distances of lists
+        int task = -1;
+        while ((task = next_task++) < num_tasks) {
+            int qstart = (task / num_parts) * GT_QTILE;
+            int qnum = std::min(GT_QTILE, qn - qstart);
+            int pid = task % num_parts;
+            int start = pid * part;
+            int end = std::min(n, start + part);
+
+            for (int i = 0; i < qnum; ++i) {
+                for (int l = 0; l < np; ++l) {
+                    part_lists[((uint64_t)l * qn + qstart + i) * num_parts + pid]->reset();
+                    kdists[i * np + l] = MAXREAL;
+                }
+            }
+            for (int t = start; t < end; t += tile) {
+                int tend = std::min(end, t + tile);
+                for (int i = 0; i < qnum; ++i) {
+                    const DType *q = &query[(uint64_t)(qstart + i) * d];
+                    for (int l = 0; l < np; ++l) {
+                        MinK_List *list = part_lists[((uint64_t)l * qn + qstart + i) * num_parts + pid];
+                        float &kdist = kdists[i * np + l];
+                        for (int j = t; j < tend; j += DIST_BATCH) {
+                            int num = std::min(DIST_BATCH, tend - j);
+                            calc_dist_batch<DType>(num, d, p[l], kdist, q, &data[(uint64_t)j * d],
+                                                   norms != NULL ? &norms[j] : NULL, dists);
+                            kdist = list->insert_batch(num, dists, j);
+                        }
+                    }
+                }
+            }
+        }
+        delete[] kdists;
+    };
+    if (num_threads == 1) {
+        worker();
+    } else {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < num_threads; ++i) threads.emplace_back(worker);
+        for (auto &t : threads) t.join();
+    }
+
+    // merge the lists of partitions in the order of ids (to break ties)
+    if (num_parts > 1) {
+        for (uint64_t i = 0; i < num_lists; ++i) {
+            lists[i]->reset();
+            for (int pid = 0; pid < num_parts; ++pid) {
+                MinK_List *list = part_lists[i * num_parts + pid];
+                for (int j = 0; j < list->size(); ++j) lists[i]->insert(list->ith_key(j), list->ith_id(j));
+            }
+        }
+        for (uint64_t i = 0; i < num_lists * num_parts; ++i) delete part_lists[i];
+        delete[] part_lists;
     }
 }
 
+// -----------------------------------------------------------------------------
+//  linear scan of a batch of queries (data on disk) by a pipeline of one
+//  reader and <g_num_threads> scanners. the reader reads the pages tile by
+//  tile (at most SCAN_TILE bytes of consecutive pages into one buffer) ahead
+//  of the scanners, bounded by a pool of 2 * <g_num_threads> buffers. each
+//  scanner takes the next tile and verifies all queries against it, with its
+//  own top-k list of each query. the tiles are taken in the order of ids, so
+//  the lists of scanners are merged by sorting their items with ties broken
+//  by ids, and the results are the same as the ones of a sequential scan.
 // -----------------------------------------------------------------------------
 template <class DType>
-uint64_t linear(          // linear scan search
+uint64_t linear(          // linear scan search of a batch of queries
     int n,                // number of data points
+    int qn,               // number of queries
     int d,                // dimensionality
     int B,                // page size
-    int p,                // l_p distance, p \in (0,2]
+    float p,              // l_p distance, p \in (0,2]
     int top_k,            // top-k value
-    const DType *query,   // query point
+    const DType *query,   // query points (qn * d)
     const char *dfolder,  // data folder
-    MinK_List *list)      // k-NN results (return)
+    MinK_List **lists)    // k-NN results of queries (qn) (return)
 {
-    list->reset();
-
-    // assume data in disk, every time read a page of data ONLY
-    char dpath[200];
-    sprintf(dpath, "%sdata/", dfolder);
-    char *buffer = new char[B];  // one page buffer
-    DType *data = new DType[d];  // one data point
-
-    // compute num of data in one page and total number of data file
+    // compute num of data in one page, total number of data file, and the
+    // number of pages in a tile
     int num = (int)floor((float)B / (d * sizeof(DType)));
     int total_file = (int)ceil((float)n / num);
+    int tile = std::max(1, std::min(total_file, SCAN_TILE / B));
+    int num_tiles = (total_file + tile - 1) / tile;
+    int num_scan = std::max(1, std::min(g_num_threads, num_tiles));
     assert(total_file > 0);
 
-    // linear scan to find the k-NN of query
-    int id = 0, start = 0;
-    float dist, kdist = MAXREAL;
+    // -------------------------------------------------------------------------
+    //  init the pool of buffers and the queue of tiles (tile id, buffer)
+    // -------------------------------------------------------------------------
+    typedef std::pair<int, char *> Tile;
+    int num_buffers = std::min(num_tiles, 2 * num_scan);
+    BoundedQueue<char *> pool(num_buffers);
+    BoundedQueue<Tile> to_scan(num_buffers);
+    for (int i = 0; i < num_buffers; ++i) pool.push(new char[(uint64_t)tile * B]);
+
+    // top-k results of queries in each scanner (the results if one scanner)
+    MinK_List **scan_lists = lists;
+    if (num_scan > 1) {
+        scan_lists = new MinK_List *[(uint64_t)num_scan * qn];
+        for (uint64_t i = 0; i < (uint64_t)num_scan * qn; ++i) scan_lists[i] = new MinK_List(top_k);
+    }
 
-    for (int i = 0; i < total_file; ++i) {
-        // read one page of data into buffer
+    // -------------------------------------------------------------------------
+    //  stage 1: read pages ahead
+    // -------------------------------------------------------------------------
+    auto read = [&]() {
         char fname[200];
-        sprintf(fname, "%s%d.data", dpath, i);
-        read_buffer_from_page(B, fname, buffer);
+        for (int t = 0; t < num_tiles; ++t) {
+            char *buffer = NULL;
+            pool.pop(buffer);
+
+            int fid = t * tile;
+            int num_pages = std::min(tile, total_file - fid);
+            for (int j = 0; j < num_pages; ++j) {
+                sprintf(fname, "%sdata/%d.data", dfolder, fid + j);
+                read_buffer_from_page(B, fname, &buffer[(uint64_t)j * B]);
+            }
+            to_scan.push(Tile(t, buffer));
+        }
+        to_scan.close();
+    };
 
-        // linear scan data points in one page buffer
-        if (start + num > n) num = n - start;
-        for (int j = 0; j < num; ++j) {
-            read_data_from_buffer<DType>(j, d, (const char *)buffer, data);
-            dist = calc_lp_dist<DType>(d, p, kdist, (const DType *)data, query);
+    // -------------------------------------------------------------------------
+    //  stage 2: scan the pages of a tile for all queries
+    // -------------------------------------------------------------------------
+    auto scan = [&](int thread_id) {
+        MinK_List **tlists = &scan_lists[(uint64_t)thread_id * qn];
+        float *dists = new float[num];  // distances of data in one page
+        float *kdists = new float[qn];  // k-th distances of queries
+        for (int i = 0; i < qn; ++i) {
+            tlists[i]->reset();
+            kdists[i] = MAXREAL;
+        }
 
-            // data ID starts from 0
-            kdist = list->insert(dist, id++);
+        Tile t;
+        while (to_scan.pop(t)) {
+            int fid = t.first * tile;
+            int num_pages = std::min(tile, total_file - fid);
+            for (int i = 0; i < qn; ++i) {
+                const DType *q = &query[(uint64_t)i * d];
+                for (int j = 0; j < num_pages; ++j) {
+                    // data points in one page (stored contiguously), ID from 0
+                    int id = (fid + j) * num;
+                    int cnt = std::min(num, n - id);
+                    const DType *page = (const DType *)&t.second[(uint64_t)j * B];
+
+                    calc_dist_batch<DType>(cnt, d, p, kdists[i], q, page, NULL, dists);
+                    kdists[i] = tlists[i]->insert_batch(cnt, dists, id);
+                }
+            }
+            pool.push(t.second);
         }
-        start += num;
+        delete[] dists;
+        delete[] kdists;
+    };
+
+    std::vector<std::thread> threads;
+    threads.emplace_back(read);
+    for (int i = 0; i < num_scan; ++i) threads.emplace_back(scan, i);
+    for (auto &t : threads) t.join();
+
+    char *buffer = NULL;
+    pool.close();
+    while (pool.pop(buffer)) delete[] buffer;
+
+    // merge the lists of scanners (ties are broken by ids)
+    if (num_scan > 1) {
+        Result *res = new Result[(uint64_t)num_scan * top_k];
+        for (int i = 0; i < qn; ++i) {
+            int cnt = 0;
+            for (int t = 0; t < num_scan; ++t) {
+                MinK_List *list = scan_lists[(uint64_t)t * qn + i];
+                for (int j = 0; j < list->size(); ++j) {
+                    res[cnt].key_ = list->ith_key(j);
+                    res[cnt].id_ = list->ith_id(j);
+                    ++cnt;
+                }
+            }
+            sort_results(cnt, res);
+
+            lists[i]->reset();
+            for (int j = 0; j < std::min(cnt, top_k); ++j) lists[i]->insert(res[j].key_, res[j].id_);
+        }
+        for (uint64_t i = 0; i < (uint64_t)num_scan * qn; ++i) delete scan_lists[i];
+        delete[] scan_lists;
+        delete[] res;
     }
-    assert(start == n && id == n);
-    delete[] buffer;
-    delete[] data;
-
     return (uint64_t)total_file;
 }
 